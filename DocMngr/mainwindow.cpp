@@ -50,6 +50,7 @@
 #include <QInputDialog>
 #include <QScrollArea>
 #include <QSplitter>
+#include <QScrollBar>
 
 #include "mrpccli.h"
 #include "viewer.h"
@@ -76,6 +77,7 @@ ObjRegister(SessionLogin);
 ObjRegister(SessionResult);
 ObjRegister(PublicKey);
 ObjRegister(Progress);
+ObjRegister(Ping);
 
 ObjRegister(Document);
 ObjRegister(DocumentRaw);
@@ -104,6 +106,11 @@ MainWindow::MainWindow(QWidget *parent) :
   MrpcClient::privateKey = obj.value("main/privkey").toString().toStdString();
 
   ui->pushButtonSave->setEnabled(false);
+  // weitere Treffer nachladen, sobald das Ende der Liste erreicht ist
+  connect(ui->treeWidget->verticalScrollBar(), &QScrollBar::valueChanged, [this](int v) {
+    if (v == ui->treeWidget->verticalScrollBar()->maximum())
+      searchMore();
+  });
 
 
   QTimer::singleShot(1, this, SLOT(initKey()));
@@ -112,6 +119,7 @@ MainWindow::MainWindow(QWidget *parent) :
 
 MainWindow::~MainWindow()
 {
+    MrpcClient::closeAll();
     delete ui;
 }
 
@@ -648,7 +656,7 @@ void MainWindow::save() {
       if (not s->evaluate(doc.tags, false))
         return;
 
-    mrpc = new MrpcClient(this);
+    mrpc = MrpcClient::acquire(this);
     mrpc->waitReady(5);
     LOG(LM_INFO, "MAIN connected save " << file->size());
 
@@ -680,11 +688,11 @@ void MainWindow::save() {
     }
     else
       result = "now answer";
-    mrpc->waitDone();
+    mrpc->release();
+    mrpc = nullptr;
     LOG(LM_INFO, "MAIN ready");
     ui->pushButtonSave->setEnabled(false);
 
-    mrpc->close();
     ui->statusbar->showMessage(tr("%1 %2").arg(t1).arg(t2), 10000);
 
     QMessageBox::information(this, windowTitle(), QString::fromUtf8(result.c_str()));
@@ -694,6 +702,9 @@ void MainWindow::save() {
     QMessageBox::information(this, windowTitle(), QString::fromUtf8(e.what()));
 
   }
+  // nach Fehlern nie in den Pool zurückgeben
+  if (mrpc)
+    mrpc->close();
   mrpc = nullptr;
 
 
@@ -848,23 +859,24 @@ void MainWindow::getConfiguration() {
     }
   }
   try {
-    mrpc = new MrpcClient(this);
+    mrpc = MrpcClient::acquire(this);
     mrpc->waitReady(5);
     LOG(LM_INFO, "MAIN connected");
 
     GetConfig gc;
     gc.start(true);
+    gc.reqId(MrpcClient::nextRequestId());
 
     LOG(LM_INFO, "MAIN sent");
     int t1 = mrpc->elapsed.nsecsElapsed() / 1000000;
 
     mobs::ObjectBase *obj = mrpc->sendAndWaitObj(&gc, 10);
-    mrpc->waitDone();
 
     int t2 = mrpc->elapsed.nsecsElapsed() / 1000000;
     ui->statusbar->showMessage(tr("ms: %1 %2").arg(t1).arg(t2), 10000);
 
-    mrpc->close();
+    mrpc->release();
+    mrpc = nullptr;
     LOG(LM_INFO, "MAIN received " << obj->to_string());
     std::ofstream oo("conf.json");
     oo << obj->to_string(mobs::ConvObjToString().exportJson().doIndent());
@@ -887,9 +899,14 @@ void MainWindow::getConfiguration() {
     LOG(LM_ERROR, "Exception in getConfig " << e.what());
     QMessageBox::information(this, windowTitle(), tr("no connection"));
   }
+  // nach Fehlern nie in den Pool zurückgeben
+  if (mrpc)
+    mrpc->close();
   mrpc = nullptr;
 }
 
+const int searchPageSize = 200; // Dokumente je Anfrage
+
 void MainWindow::searchDocument() {
   auto i = actionTemplates.find(ui->tabWidgetTags->currentIndex());
   if (i == actionTemplates.end())
@@ -897,6 +914,11 @@ void MainWindow::searchDocument() {
   auto &currentTemplate = i->second;
 
   ui->treeWidget->clear();
+  searchCursor.clear();
+  searchTemplate = i->first;
+  searchShown = 0;
+  searchGroups.clear();
+  searchGrpRepeat.clear();
 //  ui->treeWidget->setColumnCount(1);
 //  ui->treeWidget->setRowCount(0);
   int columns = currentTemplate.tableHeads.size()+1;
@@ -908,129 +930,161 @@ void MainWindow::searchDocument() {
   ui->treeWidget->setHeaderLabels(head);
 //  ui->treeWidget->setHorizontalHeaderItem(col, new QTableWidgetItem(tagName));
 
-  try {
-    SearchDocument sd;
-    sd.templateName(currentTemplate.name);
-    for (auto s:currentTemplate.searchTags) {
-      if (not s->evaluate(sd.tags, true))
-        return;
-    }
+  SearchDocument sd;
+  sd.templateName(currentTemplate.name);
+  for (auto s:currentTemplate.searchTags) {
+    if (not s->evaluate(sd.tags, true))
+      return;
+  }
+  sd.limit(searchPageSize);
+  searchRequest(sd, currentTemplate);
+}
+
+void MainWindow::searchMore() {
+  if (searchCursor.empty() or mrpc)
+    return;
+  auto i = actionTemplates.find(searchTemplate);
+  if (i == actionTemplates.end())
+    return;
+  SearchDocument sd;
+  sd.templateName(i->second.name);
+  sd.cursor(searchCursor);
+  sd.limit(searchPageSize);
+  searchRequest(sd, i->second);
+}
 
-    mrpc = new MrpcClient(this);
+void MainWindow::searchRequest(SearchDocument &sd, ActionTemplate &currentTemplate) {
+  searchCursor.clear();
+  try {
+    mrpc = MrpcClient::acquire(this);
     mrpc->waitReady(5);
     LOG(LM_INFO, "MAIN connected");
 
     LOG(LM_INFO, "MAIN sent");
     int t1 = mrpc->elapsed.nsecsElapsed() / 1000000;
 
+    sd.reqId(MrpcClient::nextRequestId());
     mobs::ObjectBase *obj = mrpc->sendAndWaitObj(&sd, 90);
 //    mobs::ObjectBase *obj = mrpc->execNextObj(10);
     int t2 = mrpc->elapsed.nsecsElapsed() / 1000000;
-    ui->statusbar->showMessage(tr("ms: %1 %2").arg(t1).arg(t2), 10000);
 
     LOG(LM_INFO, "MAIN received");
 
+    int64_t total = 0;
     if (obj) {
       LOG(LM_INFO, "RESULT " << obj->to_string());
       if (auto res = dynamic_cast<SearchDocumentResult *>(obj)) {
-        std::map<std::string, QTreeWidgetItem *> groups;
-        std::set<int> grpRepeat;
-        for(auto &i:res->tags) {
-          LOG(LM_INFO, "Result: " << i.docId());
-//          int row = ui->treeWidget->rowCount();
-//          ui->treeWidget->setRowCount(row+1);
-//          ui->treeWidget->setItem(row, 0, new QTableWidgetItem(QString::number(i.docId())));
-          std::string groupId;
-          int groupCol = -1;
-          bool prim = false;
-          QList<QString> line;
-          line.reserve(columns);
-          for (int c = 1; c < columns; c++)
-            line << "";
-          line << QString::number(i.docId());
-
-          for (auto &j:i.tags) {
-            if (j.name() == "prim$$") {
-              prim = true;
-              continue;
-            }
-            auto info = currentTemplate.tableDisplay.find(j.name());
-            if (info == currentTemplate.tableDisplay.end()) {
-              LOG(LM_INFO, "UNUSED " << j.name() << "=" << j.content());
-              continue;
-            }
-            int col = currentTemplate.getDispPos(info->second.maskName);
-            if (info->second.groupRepeat)
-              grpRepeat.insert(col);
-            if (info->second.groupBy) {
-              groupId = j.content();
-              groupCol = col;
-            }
-            if (col < 0)
-              continue;
-
-            currentTemplate.foundTag(j.name());// TODO ???
-            LOG(LM_INFO, "T " << j.name() << "=" << j.content());
-            std::wstring value = mobs::to_wstring(j.content());
-            if (info->second.isDate) {
-              auto d = QDateTime::fromString(j.content().c_str(), Qt::ISODate);
-              LOG(LM_INFO, "DATE " << d.toString(Qt::DefaultLocaleShortDate).toStdString());
-              if (info->second.form.empty())
-                 value = d.date().toString(Qt::DefaultLocaleShortDate).toStdWString();
-              else
-                 value = d.toLocalTime().toString(Qt::DefaultLocaleShortDate).toStdWString();
-            } else if (not info->second.formatter.empty()) {
-              std::wstring result;
-              if (info->second.formatter.format(value, result))
-                value = result;
-            }
-            line.replace(col, QString::fromStdWString(value));
-//            ui->treeWidget->setItem(row, col, new QTableWidgetItem());
-          }
-          QTreeWidgetItem *gp = nullptr;
-          LOG(LM_INFO, "GROUP " << groupId);
-          if (not groupId.empty()) {
-            auto it = groups.find(groupId);
-            if (it != groups.end())
-              gp = it->second;
-          }
-          if (gp) {
-            line.replace(groupCol, ""); // clear group id
-            for (auto c:grpRepeat)  // duplicate from group leader
-              line.replace(c, gp->text(c));
-            gp->addChild(new QTreeWidgetItem(gp, line));
-            LOG(LM_INFO, "CHILD " << gp->childCount());
-          } else {
-            LOG(LM_INFO, "TOPLEVEL");
-            gp = new QTreeWidgetItem(ui->treeWidget, line);
-            gp->setChildIndicatorPolicy(QTreeWidgetItem::DontShowIndicatorWhenChildless);
-            if (not groupId.empty())
-              groups[groupId] = gp;
-            ui->treeWidget->addTopLevelItem(gp);
-          }
-
-        }
+        showSearchResult(*res, currentTemplate);
+        searchCursor = res->cursor();
+        total = res->total();
       }
       else
         LOG(LM_INFO, "RESULT unused " << obj->to_string());
 
     }
-    for (int i = 0; i < columns-1; i++)
+    ui->statusbar->showMessage(tr("ms: %1 %2 documents: %3/%4").arg(t1).arg(t2).arg(searchShown).arg(total), 10000);
+    for (int i = 0; i < ui->treeWidget->columnCount()-1; i++)
       ui->treeWidget->resizeColumnToContents(i);
 
-    mrpc->waitDone();
+    mrpc->release();
+    mrpc = nullptr;
     LOG(LM_INFO, "MAIN ready");
-    mrpc->close();
   } catch (ExcCancelled &e) {
     LOG(LM_ERROR, "Exception in load " << e.what());
     ui->statusbar->showMessage(tr("cancelled"), 10000);
+  } catch (ExcTimeout &e) {
+    LOG(LM_ERROR, "Exception in load " << e.what());
+    QMessageBox::information(this, windowTitle(), tr("search took too long, please narrow the search"));
   } catch (std::exception &e) {
     LOG(LM_ERROR, "Exception in load " << e.what());
     QMessageBox::information(this, windowTitle(), QString::fromUtf8(e.what()));
   }
+  // nach Fehlern nie in den Pool zurückgeben
+  if (mrpc)
+    mrpc->close();
   mrpc = nullptr;
+  // solange die Liste nicht scrollbar ist, weitere Seiten laden
+  if (not searchCursor.empty() and ui->treeWidget->verticalScrollBar()->maximum() == 0)
+    QTimer::singleShot(0, this, SLOT(searchMore()));
+}
 
+void MainWindow::showSearchResult(SearchDocumentResult &res, ActionTemplate &currentTemplate) {
+  int columns = currentTemplate.tableHeads.size()+1;
+  for(auto &i:res.tags) {
+    LOG(LM_INFO, "Result: " << i.docId());
+//          int row = ui->treeWidget->rowCount();
+//          ui->treeWidget->setRowCount(row+1);
+//          ui->treeWidget->setItem(row, 0, new QTableWidgetItem(QString::number(i.docId())));
+    std::string groupId;
+    int groupCol = -1;
+    bool prim = false;
+    QList<QString> line;
+    line.reserve(columns);
+    for (int c = 1; c < columns; c++)
+      line << "";
+    line << QString::number(i.docId());
+
+    for (auto &j:i.tags) {
+      if (j.name() == "prim$$") {
+        prim = true;
+        continue;
+      }
+      auto info = currentTemplate.tableDisplay.find(j.name());
+      if (info == currentTemplate.tableDisplay.end()) {
+        LOG(LM_INFO, "UNUSED " << j.name() << "=" << j.content());
+        continue;
+      }
+      int col = currentTemplate.getDispPos(info->second.maskName);
+      if (info->second.groupRepeat)
+        searchGrpRepeat.insert(col);
+      if (info->second.groupBy) {
+        groupId = j.content();
+        groupCol = col;
+      }
+      if (col < 0)
+        continue;
 
+      currentTemplate.foundTag(j.name());// TODO ???
+      LOG(LM_INFO, "T " << j.name() << "=" << j.content());
+      std::wstring value = mobs::to_wstring(j.content());
+      if (info->second.isDate) {
+        auto d = QDateTime::fromString(j.content().c_str(), Qt::ISODate);
+        LOG(LM_INFO, "DATE " << d.toString(Qt::DefaultLocaleShortDate).toStdString());
+        if (info->second.form.empty())
+           value = d.date().toString(Qt::DefaultLocaleShortDate).toStdWString();
+        else
+           value = d.toLocalTime().toString(Qt::DefaultLocaleShortDate).toStdWString();
+      } else if (not info->second.formatter.empty()) {
+        std::wstring result;
+        if (info->second.formatter.format(value, result))
+          value = result;
+      }
+      line.replace(col, QString::fromStdWString(value));
+//            ui->treeWidget->setItem(row, col, new QTableWidgetItem());
+    }
+    QTreeWidgetItem *gp = nullptr;
+    LOG(LM_INFO, "GROUP " << groupId);
+    if (not groupId.empty()) {
+      auto it = searchGroups.find(groupId);
+      if (it != searchGroups.end())
+        gp = it->second;
+    }
+    if (gp) {
+      line.replace(groupCol, ""); // clear group id
+      for (auto c:searchGrpRepeat)  // duplicate from group leader
+        line.replace(c, gp->text(c));
+      gp->addChild(new QTreeWidgetItem(gp, line));
+      LOG(LM_INFO, "CHILD " << gp->childCount());
+    } else {
+      LOG(LM_INFO, "TOPLEVEL");
+      gp = new QTreeWidgetItem(ui->treeWidget, line);
+      gp->setChildIndicatorPolicy(QTreeWidgetItem::DontShowIndicatorWhenChildless);
+      if (not groupId.empty())
+        searchGroups[groupId] = gp;
+      ui->treeWidget->addTopLevelItem(gp);
+    }
+    searchShown++;
+  }
 }
 
 void MainWindow::getDocument() {
@@ -1050,7 +1104,7 @@ void MainWindow::loadDocument(int64_t doc)
 {
   ui->pushButtonSave->setEnabled(false);
   try {
-    mrpc = new MrpcClient(this);
+    mrpc = MrpcClient::acquire(this);
     mrpc->waitReady(5);
     LOG(LM_INFO, "MAIN connected");
 
@@ -1058,6 +1112,7 @@ void MainWindow::loadDocument(int64_t doc)
     //gd.name("Auto.jpg");
     gd.docId(doc);
     gd.allowAttach(true);
+    gd.reqId(MrpcClient::nextRequestId());
 //    mrpc->send(&gd);
     LOG(LM_INFO, "MAIN sent");
     int t1 = mrpc->elapsed.nsecsElapsed() / 1000000;
@@ -1095,10 +1150,9 @@ void MainWindow::loadDocument(int64_t doc)
       } else
         LOG(LM_INFO, "RESULT unused " << obj->to_string());
     }
-    mrpc->waitDone();
+    mrpc->release();
+    mrpc = nullptr;
     LOG(LM_INFO, "MAIN ready");
-
-    mrpc->close();
   } catch (ExcAccess &e) {
     LOG(LM_ERROR, "Exception in load doc " << e.what());
     ui->widget->clearViewer();
@@ -1111,6 +1165,9 @@ void MainWindow::loadDocument(int64_t doc)
     QMessageBox::information(this, windowTitle(), QString::fromUtf8(e.what()));
 
   }
+  // nach Fehlern nie in den Pool zurückgeben
+  if (mrpc)
+    mrpc->close();
   mrpc = nullptr;
 
 
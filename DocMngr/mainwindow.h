@@ -24,6 +24,7 @@
 #include <QElapsedTimer>
 #include <QtNetwork/QTcpSocket>
 #include <mrpc.h>
+#include <set>
 
 #include "mrpccli.h"
 
@@ -54,6 +55,7 @@ public slots:
   void saveFile();
   void getDocument();
   void searchDocument();
+  void searchMore();
   void searchRowClicked(int row, int col);
   void searchRowClicked(QTreeWidgetItem*,int);
   void initKey();
@@ -67,7 +69,16 @@ private:
   QString currentFile;
   std::map<int, ActionTemplate> actionTemplates;
 
+  // Zustand der seitenweise geladenen Suche
+  std::string searchCursor; // Fortsetzung, leer wenn vollständig
+  int searchTemplate = -1;
+  int searchShown = 0;
+  std::map<std::string, QTreeWidgetItem *> searchGroups;
+  std::set<int> searchGrpRepeat;
+
   void initTags(const TemplateInfo &templateInfo);
+  void searchRequest(SearchDocument &sd, ActionTemplate &currentTemplate);
+  void showSearchResult(SearchDocumentResult &res, ActionTemplate &currentTemplate);
 
 };
 
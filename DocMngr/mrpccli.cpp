@@ -190,10 +190,12 @@ public:
       if (sess->error() == SErrNeedCredentioal)
       {
         XmlInput::sessionKey.clear();
+        XmlInput::sessionTicket.clear();
         XmlInput::sessionId = 0;
         skipDelim = true;
       } else if (sess->error() == SErrInvalidCert) {
         XmlInput::sessionKey.clear();
+        XmlInput::sessionTicket.clear();
         XmlInput::sessionId = 0;
         errorMsg = "CERT";
         skipDelim = true;
@@ -202,12 +204,16 @@ public:
         skipDelim = true;
       } else if (sess->error() == SErrAccessDenied) {
         errorMsg = "ACCESS";
-      }
+      } else if (sess->error() == SErrTimeout) {
+        errorMsg = "TIMEOUT";
+      } else
+        errorMsg = sess->msg().empty() ? "server error" : sess->msg();
       // parsen abbrechen
       stop();
     } else if (auto *sess = dynamic_cast<SessionResult *>(obj)) {
       LOG(LM_INFO, "SESSIORESULT " << sess->to_string());
       sessionId = sess->id();
+      sessionTicket = sess->ticket();
       // Session-Key mit privatem Schlüssel entschlüsseln
       mobs::decryptPrivateRsa(sess->key(), sessionKey, MrpcClient::privateKey, MrpcClient::passwd);
       // parsen abbrechen
@@ -224,6 +230,10 @@ public:
       LOG(LM_INFO, "PROGRESS " << pk->percent());
       percent = pk->percent();
       stop();
+    } else if (dynamic_cast<Ping *>(obj)) {
+      LOG(LM_INFO, "PING answered");
+      pingPending = false;
+      stop();
     } else {
       objReturn = obj;
       stop();
@@ -239,17 +249,44 @@ public:
   bool skipDelim = false;
 //  bool newBlock = false;
   int percent = -1;
+  bool pingPending = false; // Keep-Alive gesendet, Antwort steht aus
 
   std::string errorMsg;
 
   static std::string serverPubKey;
   static uint sessionId;
   static std::vector<u_char> sessionKey;
+  static std::vector<u_char> sessionTicket; // stellt die Session nach Verfall auf dem Server ohne RSA wieder her
 
 };
 std::string XmlInput::serverPubKey;
 uint XmlInput::sessionId = 0;
 std::vector<u_char> XmlInput::sessionKey;
+std::vector<u_char> XmlInput::sessionTicket;
+
+/// Kennung einer Anfrage bzw. Antwort, 0 = ohne reqId
+static int64_t requestId(const mobs::ObjectBase *obj) {
+  if (auto *o = dynamic_cast<const SearchDocument *>(obj))
+    return o->reqId();
+  if (auto *o = dynamic_cast<const GetDocument *>(obj))
+    return o->reqId();
+  if (auto *o = dynamic_cast<const GetConfig *>(obj))
+    return o->reqId();
+  if (auto *o = dynamic_cast<const SearchDocumentResult *>(obj))
+    return o->reqId();
+  if (auto *o = dynamic_cast<const Document *>(obj))
+    return o->reqId();
+  if (auto *o = dynamic_cast<const DocumentRaw *>(obj))
+    return o->reqId();
+  if (auto *o = dynamic_cast<const ConfigResult *>(obj))
+    return o->reqId();
+  return 0;
+}
+
+// Abstand der Keep-Alive-Pings ruhender Verbindungen
+const int keepAliveInterval = 30000;
+// maximale Anzahl ruhender Verbindungen
+const size_t poolSize = 2;
 
 class MrpcClientData {
 public:
@@ -288,6 +325,7 @@ public:
   std::istream *attachmentStream = nullptr;
   std::vector<u_char> attachment;
   int64_t attachmentSize = 0;
+  bool answerPending = false; // Antwort bzw. deren Attachment noch nicht vollständig gelesen
 
   QFile *sendFile = nullptr;
 
@@ -301,12 +339,10 @@ MrpcClient::MrpcClient(QWidget *parent) : QObject() {
   data = new MrpcClientData;
   elapsed.start();
   eventLoop = new QEventLoop(this);
+  keepAliveTimer = new QTimer(this);
+  connect(keepAliveTimer, SIGNAL(timeout()), this, SLOT(keepAlive()));
 
-  progress = new QProgressDialog(tr("Verbindung"), tr("Abbruch"), 0, 100, parent);
-  connect(progress, SIGNAL(canceled()), this, SLOT(canceled()));
-  progress->setWindowModality(Qt::WindowModal);
-  progress->setMinimumDuration(800);
-  progress->setValue(0);
+  startProgress(parent);
 
   socket = new QTcpSocket();
   connect(socket, SIGNAL(connected()), this, SLOT(connected()));
@@ -324,6 +360,8 @@ MrpcClient::MrpcClient(QWidget *parent) : QObject() {
 }
 
 QString MrpcClient::server;
+std::list<MrpcClient *> MrpcClient::pool;
+int64_t MrpcClient::requestCntr = 0;
 std::string MrpcClient::privateKey;
 std::string MrpcClient::publicKey;
 std::string MrpcClient::fingerprint;
@@ -340,7 +378,101 @@ MrpcClient::~MrpcClient() {
 
 
 
+void MrpcClient::startProgress(QWidget *parent) {
+  progress = new QProgressDialog(tr("Verbindung"), tr("Abbruch"), 0, 100, parent);
+  connect(progress, SIGNAL(canceled()), this, SLOT(canceled()));
+  progress->setWindowModality(Qt::WindowModal);
+  progress->setMinimumDuration(800);
+  progress->setValue(0);
+}
+
+MrpcClient *MrpcClient::acquire(QWidget *parent) {
+  while (not pool.empty()) {
+    MrpcClient *c = pool.front();
+    pool.pop_front();
+    c->keepAliveTimer->stop();
+    if (c->idle()) {
+      LOG(LM_INFO, "MrpcClient reuse");
+      c->elapsed.start();
+      c->data->percentStart = c->data->percentEnd = 0;
+      c->startProgress(parent);
+      return c;
+    }
+    // Verbindung ist inzwischen verloren, transparent neu aufbauen
+    LOG(LM_INFO, "MrpcClient discard");
+    c->close();
+  }
+  return new MrpcClient(parent);
+}
+
+void MrpcClient::release() {
+  if (progress) {
+    progress->setValue(progress->maximum());
+    progress->deleteLater();
+    progress = nullptr;
+  }
+  // eine Verbindung mitten in einer Antwort darf nie wiederverwendet werden
+  if (not idle()) {
+    close();
+    return;
+  }
+  if (pool.size() >= poolSize) {
+    finish();
+    return;
+  }
+  LOG(LM_INFO, "MrpcClient idle");
+  data->xr.ready = true;
+  data->xr.pingPending = false;
+  pool.push_back(this);
+  keepAliveTimer->start(keepAliveInterval);
+}
+
+void MrpcClient::closeAll() {
+  while (not pool.empty()) {
+    MrpcClient *c = pool.front();
+    pool.pop_front();
+    if (c->idle())
+      c->finish();
+    else
+      c->close();
+  }
+}
+
+bool MrpcClient::idle() const {
+  return data->state == MrpcClientData::Online and socket->state() == QAbstractSocket::ConnectedState and
+         data->xr.errorMsg.empty() and not data->attachmentStream and not data->answerPending and
+         not data->xr.encryptedInput;
+}
+
+void MrpcClient::finish() {
+  LOG(LM_INFO, "MrpcClient finish");
+  keepAliveTimer->stop();
+  try {
+    waitDone();
+    socket->disconnectFromHost();
+  } catch (std::exception &e) {
+    LOG(LM_ERROR, "finish " << e.what());
+  }
+  close();
+}
+
+void MrpcClient::keepAlive() {
+  if (data->state != MrpcClientData::Online or not data->xr.errorMsg.empty() or data->xr.pingPending) {
+    // Server antwortet nicht mehr
+    LOG(LM_INFO, "keep alive failed");
+    keepAliveTimer->stop();
+    pool.remove(this);
+    close();
+    return;
+  }
+  Ping ping;
+  ping.id(1);
+  data->xr.pingPending = true;
+  send(&ping);
+}
+
 void MrpcClient::close() {
+  keepAliveTimer->stop();
   if (socket->isOpen())
     socket->abort();
   if (data->state != MrpcClientData::Error)
@@ -437,6 +569,8 @@ void MrpcClient::connected() {
     data->state = MrpcClientData::Online;
     Session sess;
     sess.id(XmlInput::sessionId);
+    if (not XmlInput::sessionTicket.empty())
+      sess.ticket(XmlInput::sessionTicket);
     sess.traverse(xo);
     data->xr.ready = true;
     eventLoop->exit(0);
@@ -523,6 +657,8 @@ int MrpcClient::exec() {
       throw ExcConn(data->xr.errorMsg);
     else if (data->xr.errorMsg == "ACCESS")
       throw ExcAccess(data->xr.errorMsg);
+    else if (data->xr.errorMsg == "TIMEOUT")
+      throw ExcTimeout(data->xr.errorMsg);
     else
       THROW("Error " << data->xr.errorMsg);
   }
@@ -731,7 +867,9 @@ void MrpcClient::send(const mobs::ObjectBase *obj) {
 mobs::ObjectBase *MrpcClient::sendAndWaitObj(const mobs::ObjectBase *obj, int percent) {
   LOG(LM_INFO, "SEND AND WAIT NEXT begin");
   data->setPercent(percent);
+  data->answerPending = true;
   send(obj);
+  int64_t reqId = requestId(obj);
 //  data->iBlkStr.startNewBlock();
   for (;;) {
     int r = exec();
@@ -743,7 +881,18 @@ mobs::ObjectBase *MrpcClient::sendAndWaitObj(const mobs::ObjectBase *obj, int pe
     }
     auto tmp = data->xr.objReturn;
     data->xr.objReturn = nullptr;
+    if (tmp and reqId and requestId(tmp) and requestId(tmp) != reqId) {
+      // verspätete Antwort einer früheren Anfrage auf dieser Verbindung
+      LOG(LM_INFO, "skip answer " << requestId(tmp) << " expected " << reqId);
+      // Attachment überlesen, sonst steht der Strom mitten in den Binärdaten
+      if (auto raw = dynamic_cast<DocumentRaw *>(tmp))
+        getAttachment(raw->size(), percent);
+      delete tmp;
+      continue;
+    }
     if (tmp) {
+      // bei DocumentRaw folgt noch das Attachment
+      data->answerPending = dynamic_cast<DocumentRaw *>(tmp) != nullptr;
       LOG(LM_INFO, "WAIT NEXT end");
       if (progress)
         progress->setValue(data->percentEnd);
@@ -755,12 +904,14 @@ mobs::ObjectBase *MrpcClient::sendAndWaitObj(const mobs::ObjectBase *obj, int pe
 mobs::ObjectBase *MrpcClient::execNextObj(int percent) {
   LOG(LM_INFO, "WAIT NEXT begin");
   data->setPercent(percent);
+  data->answerPending = true;
 //  data->iBlkStr.startNewBlock();
   for (;;) {
     exec();
     auto tmp = data->xr.objReturn;
     data->xr.objReturn = nullptr;
     if (tmp) {
+      data->answerPending = dynamic_cast<DocumentRaw *>(tmp) != nullptr;
       LOG(LM_INFO, "WAIT NEXT end");
       if (progress)
         progress->setValue(data->percentEnd);
@@ -821,6 +972,7 @@ u_char *MrpcClient::getAttachment(int64_t sz, int percent) {
 //    exec();
 //  }
   data->attachmentSize = sz;
+  data->attachment.clear();
   std::vector<u_char> iv;
   iv.resize(mobs::CryptBufAes::iv_size());
   mobs::CryptBufAes::getRand(iv);
@@ -845,6 +997,7 @@ u_char *MrpcClient::getAttachment(int64_t sz, int percent) {
     error();
     THROW("Attachment size mismatch " << data->attachment.size());
   }
+  data->answerPending = false;
   if (progress)
     progress->setValue(data->percentEnd);
   LOG(LM_INFO, "WAIT ATTACHMENT end " << sz << " buf " << mobs::CryptBufAes::iv_size() + (sz + 16) / 16 * 16);
@@ -852,6 +1005,7 @@ u_char *MrpcClient::getAttachment(int64_t sz, int percent) {
 }
 
 void MrpcClient::setHost(QString host) {
+  closeAll();
   server = host;
   XmlInput::serverPubKey.clear();
 }
@@ -26,6 +26,7 @@
 #include <QtNetwork>
 #include <QProgressDialog>
 #include <QEventLoop>
+#include <list>
 
 class MrpcClientData;
 
@@ -53,6 +54,12 @@ public:
   explicit ExcAccess(const std::string &msg) : std::runtime_error(msg) {};
 };
 
+class ExcTimeout : public std::runtime_error {
+public:
+  explicit ExcTimeout(const char *msg) : std::runtime_error(msg) {};
+  explicit ExcTimeout(const std::string &msg) : std::runtime_error(msg) {};
+};
+
 class MrpcClient : public QObject {
   Q_OBJECT
 
@@ -60,6 +67,15 @@ public:
   explicit MrpcClient(QWidget *parent = nullptr);
   ~MrpcClient();
 
+  /// ruhende, angemeldete Verbindung aus dem Pool übernehmen oder neue Verbindung aufbauen
+  static MrpcClient *acquire(QWidget *parent = nullptr);
+  /// Anfrage beendet: intakte Verbindung für die nächste Anfrage offen halten, sonst schließen
+  void release();
+  /// alle ruhenden Verbindungen schließen
+  static void closeAll();
+  /// neue Kennung für eine Anfrage (reqId)
+  static int64_t nextRequestId() { return ++requestCntr; }
+
   int exec();
   void close();
   void waitReady(int percent);
@@ -86,6 +102,7 @@ public slots:
   void bytesWritten(qint64 bytes);
   void errorOccurred(QAbstractSocket::SocketError);
   void canceled();
+  void keepAlive();
 
   void send(const mobs::ObjectBase *obj);
   void attachment(QFile *f);
@@ -96,11 +113,19 @@ private:
   QEventLoop *eventLoop = nullptr;
   MrpcClientData *data = nullptr;
   static QString server; // host:port
+  static std::list<MrpcClient *> pool; // ruhende Verbindungen
+  static int64_t requestCntr;
+  QTimer *keepAliveTimer = nullptr;
 
+  void startProgress(QWidget *parent);
   void sendLogin();
   void sendGetPub();
   void flush();
   void error();
+  /// Verbindung steht und keine Antwort ist offen
+  bool idle() const;
+  /// intakte Verbindung geordnet beenden: Listen-Tag schließen und auf das Ende vom Server warten
+  void finish();
 };
 
 
@@ -0,0 +1,148 @@
+// ADMAX Advanced Document Management And Xtras
+//
+// Copyright 2021 Matthias Lautner
+//
+// This is part of MObs https://github.com/AlMarentu/ADMAX.git
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//         http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "docidset.h"
+#include <algorithm>
+#include <iterator>
+
+#if defined(__x86_64__) and (defined(__GNUC__) or defined(__clang__))
+#define DOCIDSET_AVX2
+#include <immintrin.h>
+#endif
+
+namespace {
+
+// ab diesem Größenverhältnis wird galoppiert statt gemerged
+const size_t gallopRatio = 32;
+
+void intersectMerge(const uint64_t *a, size_t na, const uint64_t *b, size_t nb, std::vector<uint64_t> &out,
+                    size_t i = 0, size_t j = 0) {
+  while (i < na and j < nb) {
+    if (a[i] < b[j])
+      i++;
+    else if (b[j] < a[i])
+      j++;
+    else {
+      out.push_back(a[i]);
+      i++;
+      j++;
+    }
+  }
+}
+
+#ifdef DOCIDSET_AVX2
+// je 4 Elemente aus a mit allen Rotationen eines 4er-Blocks aus b vergleichen
+__attribute__((target("avx2")))
+void intersectAvx2(const uint64_t *a, size_t na, const uint64_t *b, size_t nb, std::vector<uint64_t> &out) {
+  size_t i = 0;
+  size_t j = 0;
+  while (i + 4 <= na and j + 4 <= nb) {
+    __m256i va = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(a + i));
+    __m256i vb = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(b + j));
+    __m256i c = _mm256_cmpeq_epi64(va, vb);
+    c = _mm256_or_si256(c, _mm256_cmpeq_epi64(va, _mm256_permute4x64_epi64(vb, _MM_SHUFFLE(0, 3, 2, 1))));
+    c = _mm256_or_si256(c, _mm256_cmpeq_epi64(va, _mm256_permute4x64_epi64(vb, _MM_SHUFFLE(1, 0, 3, 2))));
+    c = _mm256_or_si256(c, _mm256_cmpeq_epi64(va, _mm256_permute4x64_epi64(vb, _MM_SHUFFLE(2, 1, 0, 3))));
+    int mask = _mm256_movemask_pd(_mm256_castsi256_pd(c));
+    for (int k = 0; mask; k++, mask >>= 1)
+      if (mask & 1)
+        out.push_back(a[i + k]);
+    uint64_t amax = a[i + 3];
+    uint64_t bmax = b[j + 3];
+    if (amax <= bmax)
+      i += 4;
+    if (bmax <= amax)
+      j += 4;
+  }
+  intersectMerge(a, na, b, nb, out, i, j);
+}
+
+bool haveAvx2() {
+  static const bool avx2 = __builtin_cpu_supports("avx2");
+  return avx2;
+}
+#endif
+
+// jedes Element aus small in large suchen, Schrittweite verdoppeln
+void intersectGallop(const uint64_t *small, size_t ns, const uint64_t *large, size_t nl, std::vector<uint64_t> &out) {
+  size_t lo = 0;
+  for (size_t i = 0; i < ns and lo < nl; i++) {
+    uint64_t v = small[i];
+    size_t step = 1;
+    size_t hi = lo;
+    while (hi < nl and large[hi] < v) {
+      lo = hi + 1;
+      hi += step;
+      step *= 2;
+    }
+    if (hi > nl)
+      hi = nl;
+    lo = size_t(std::lower_bound(large + lo, large + hi, v) - large);
+    if (lo < nl and large[lo] == v)
+      out.push_back(v);
+  }
+}
+
+}
+
+
+void DocIdSet::normalize() {
+  if (not std::is_sorted(ids.begin(), ids.end()))
+    std::sort(ids.begin(), ids.end());
+  ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+}
+
+bool DocIdSet::contains(uint64_t id) const {
+  return std::binary_search(ids.begin(), ids.end(), id);
+}
+
+void DocIdSet::intersect(const DocIdSet &a, const DocIdSet &b, DocIdSet &result) {
+  const DocIdSet &s = a.size() <= b.size() ? a : b;
+  const DocIdSet &l = a.size() <= b.size() ? b : a;
+  std::vector<uint64_t> out;
+  out.reserve(s.size());
+  if (s.empty())
+    out.clear();
+  else if (s.size() * gallopRatio < l.size())
+    intersectGallop(&s.ids[0], s.size(), &l.ids[0], l.size(), out);
+#ifdef DOCIDSET_AVX2
+  else if (haveAvx2())
+    intersectAvx2(&s.ids[0], s.size(), &l.ids[0], l.size(), out);
+#endif
+  else
+    intersectMerge(&s.ids[0], s.size(), &l.ids[0], l.size(), out);
+  result.ids.swap(out);
+}
+
+void DocIdSet::unite(const DocIdSet &a, const DocIdSet &b, DocIdSet &result) {
+  std::vector<uint64_t> out;
+  out.reserve(a.size() + b.size());
+  std::set_union(a.ids.begin(), a.ids.end(), b.ids.begin(), b.ids.end(), std::back_inserter(out));
+  result.ids.swap(out);
+}
+
+DocIdSet &DocIdSet::operator&=(const DocIdSet &other) {
+  intersect(*this, other, *this);
+  return *this;
+}
+
+DocIdSet &DocIdSet::operator|=(const DocIdSet &other) {
+  unite(*this, other, *this);
+  return *this;
+}
@@ -0,0 +1,64 @@
+// ADMAX Advanced Document Management And Xtras
+//
+// Copyright 2021 Matthias Lautner
+//
+// This is part of MObs https://github.com/AlMarentu/ADMAX.git
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//         http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef MOBS_DOCIDSET_H
+#define MOBS_DOCIDSET_H
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+/** \brief Menge von DocIds als sortiertes, zusammenhängendes Array
+ *
+ * Ids werden mit push_back gesammelt und mit normalize() sortiert und eindeutig gemacht; alle anderen
+ * Methoden setzen eine normalisierte Menge voraus.
+ * Die Schnittmenge verwendet bei stark unterschiedlichen Größen galoppierende Suche, sonst einen
+ * Merge, der auf x86_64 mit AVX2 blockweise vergleicht.
+ */
+class DocIdSet {
+public:
+  using const_iterator = std::vector<uint64_t>::const_iterator;
+
+  DocIdSet() = default;
+  template<class It>
+  DocIdSet(It first, It last) : ids(first, last) { normalize(); }
+
+  void push_back(uint64_t id) { ids.push_back(id); }
+  /// sortieren und Duplikate entfernen
+  void normalize();
+  bool contains(uint64_t id) const;
+  size_t size() const { return ids.size(); }
+  bool empty() const { return ids.empty(); }
+  void clear() { ids.clear(); }
+  void reserve(size_t n) { ids.reserve(n); }
+  void swap(DocIdSet &other) { ids.swap(other.ids); }
+  const_iterator begin() const { return ids.begin(); }
+  const_iterator end() const { return ids.end(); }
+
+  static void intersect(const DocIdSet &a, const DocIdSet &b, DocIdSet &result);
+  static void unite(const DocIdSet &a, const DocIdSet &b, DocIdSet &result);
+  DocIdSet &operator&=(const DocIdSet &other);
+  DocIdSet &operator|=(const DocIdSet &other);
+
+private:
+  std::vector<uint64_t> ids;
+};
+
+
+#endif //MOBS_DOCIDSET_H
@@ -26,12 +26,26 @@
 #include <sys/stat.h>
 #include <set>
 #include <utility>
+#include <mutex>
+#include <tuple>
+#include <chrono>
+#include <algorithm>
+#include <cctype>
+#include <vector>
+#include <unordered_map>
+#include <queue>
+#include <deque>
+#include <thread>
+#include <future>
+#include <condition_variable>
 #include <mobs/rsa.h>
 //#include <unistd.h>
 #include "mobs/dbifc.h"
 #include "mobs/logging.h"
 
 #include "mrpc.h"
+#include "tagindex.h"
+#include "docidset.h"
 
 /*
  * use docsrv
@@ -66,16 +80,71 @@ public:
  *
  * 1 DMGR_Document
  * 2 DMGR_TagPool
+ * 3 DMGR_Tag
+ * 4 DMGR_BucketInfo
+ * 5 Version der Konfiguration (Templates und Buckets)
+ *
+ * der Zähler wird als hi-Wert für IdAllocator verwendet
  */
 class DMGR_Counter : virtual public mobs::ObjectBase {
 public:
-  enum Cntr { CntrDocument = 1, CntrTagPool  = 2, CntrTag  = 3, CntrBucketInfo = 4 };
+  enum Cntr { CntrDocument = 1, CntrTagPool  = 2, CntrTag  = 3, CntrBucketInfo = 4, CntrConfig = 5 };
   ObjInit(DMGR_Counter);
   MemVar(int, id, KEYELEMENT1);
   MemVar(int64_t, counter, VERSIONFIELD);
 };
 
 
+/** \brief Vergabe von Ids in Blöcken (hi/lo)
+ *
+ * Pro Block wird der DMGR_Counter einmal erhöht (hi), die Ids des Blocks (lo) werden aus dem Speicher vergeben:
+ * Id = hi * blockSize + lo. Da das Erhöhen des Counters über das Versionsfeld abgesichert ist, bleiben die Ids
+ * auch bei mehreren Server-Prozessen auf einer DB eindeutig.
+ * Die Blockgröße eines Counters darf nachträglich nicht verkleinert werden.
+ */
+class IdAllocator {
+public:
+  IdAllocator(DMGR_Counter::Cntr c, int64_t bs) : cntrId(c), blockSize(bs) {}
+  int64_t next(mobs::DatabaseInterface &dbi);
+
+private:
+  std::mutex mutex;
+  DMGR_Counter::Cntr cntrId;
+  int64_t blockSize;
+  int64_t current = 0;
+  int64_t end = 0;
+};
+
+int64_t IdAllocator::next(mobs::DatabaseInterface &dbi) {
+  std::lock_guard<std::mutex> guard(mutex);
+  if (current >= end) {
+    for (int retry = 0;; retry++) {
+      DMGR_Counter cntr;
+      cntr.id(cntrId);
+      try {
+        dbi.load(cntr);
+        dbi.save(cntr);
+        current = cntr.counter() * blockSize;
+        end = current + blockSize;
+        break;
+      } catch (std::exception &e) {
+        // anderer Prozess hat den Counter gleichzeitig erhöht
+        if (retry >= 5)
+          throw;
+        LOG(LM_INFO, "counter " << cntrId << " conflict, retry " << e.what());
+      }
+    }
+    LOG(LM_INFO, "counter " << cntrId << " new block " << current);
+  }
+  return current++;
+}
+
+static IdAllocator idsDocument(DMGR_Counter::CntrDocument, 32);
+static IdAllocator idsTagPool(DMGR_Counter::CntrTagPool, 16);
+static IdAllocator idsTag(DMGR_Counter::CntrTag, 256);
+static IdAllocator idsBucketInfo(DMGR_Counter::CntrBucketInfo, 16);
+
+
 class DMGR_TagInfo : virtual public mobs::ObjectBase {
 public:
   ObjInit(DMGR_TagInfo);
@@ -87,6 +156,77 @@ public:
   MemVar(int, maxSize);
 };
 
+/** \brief Prozessweites Verzeichnis der DMGR_TagInfo (pool, name, bucket) <-> id
+ *
+ * Wird beim Start geladen und bei neuen Tags ergänzt. Unbekannte Einträge werden in der DB nachgeschlagen,
+ * da sie von einem anderen Server-Prozess angelegt sein können.
+ */
+class TagDictionary {
+public:
+  void load(mobs::DatabaseInterface &dbi);
+  /// neu laden, wenn letztes Laden länger als 30 s zurückliegt; return true, wenn geladen
+  bool refresh(mobs::DatabaseInterface &dbi);
+  void insert(const DMGR_TagInfo &tpool);
+  /// return 0, wenn nicht im Cache
+  TagId find(const std::string &pool, const std::string &name, int bucket);
+  bool name(TagId id, std::string &name);
+
+private:
+  using Key = std::tuple<std::string, std::string, int>;
+  std::mutex mutex;
+  std::map<Key, TagId> ids;
+  std::map<TagId, std::string> names;
+  std::chrono::steady_clock::time_point loadTime{};
+};
+
+void TagDictionary::load(mobs::DatabaseInterface &dbi) {
+  using Q = mobs::QueryGenerator;
+  Q query;
+  DMGR_TagInfo tpool;
+  for (auto cursor = dbi.query(tpool, query); not cursor->eof(); cursor->next()) {
+    dbi.retrieve(tpool, cursor);
+    insert(tpool);
+  }
+  std::lock_guard<std::mutex> guard(mutex);
+  loadTime = std::chrono::steady_clock::now();
+  LOG(LM_INFO, "tag dictionary " << names.size() << " tags");
+}
+
+bool TagDictionary::refresh(mobs::DatabaseInterface &dbi) {
+  {
+    std::lock_guard<std::mutex> guard(mutex);
+    if (std::chrono::steady_clock::now() - loadTime < std::chrono::seconds(30))
+      return false;
+    loadTime = std::chrono::steady_clock::now();
+  }
+  load(dbi);
+  return true;
+}
+
+void TagDictionary::insert(const DMGR_TagInfo &tpool) {
+  std::lock_guard<std::mutex> guard(mutex);
+  ids[Key(tpool.pool(), tpool.name(), tpool.bucket())] = tpool.id();
+  names[tpool.id()] = tpool.name();
+}
+
+TagId TagDictionary::find(const std::string &pool, const std::string &name, int bucket) {
+  std::lock_guard<std::mutex> guard(mutex);
+  auto it = ids.find(Key(pool, name, bucket));
+  return it == ids.end() ? 0 : it->second;
+}
+
+bool TagDictionary::name(TagId id, std::string &name) {
+  std::lock_guard<std::mutex> guard(mutex);
+  auto it = names.find(id);
+  if (it == names.end())
+    return false;
+  name = it->second;
+  return true;
+}
+
+static TagDictionary tagDictionary;
+
+
 class DMGR_TemplatePool : virtual public TemplateInfo {
 public:
   ObjInit(DMGR_TemplatePool);
@@ -145,6 +285,16 @@ public:
 
 };
 
+/// Posting-Liste der Trigramme von Such-Tags (name$$) für die Teilwortsuche
+class DMGR_Trigram : virtual public mobs::ObjectBase {
+public:
+  ObjInit(DMGR_Trigram);
+  MemVar(int, tagId, KEYELEMENT1);
+  MemVar(std::string, gram, KEYELEMENT2);
+  MemVar(uint64_t, docId, KEYELEMENT3);
+
+};
+
 class DMGR_ServerKey : virtual public mobs::ObjectBase {
 public:
   ObjInit(DMGR_ServerKey);
@@ -154,6 +304,566 @@ public:
 
 };
 
+/** \brief Statistik je tagId zur Abschätzung der Selektivität von Suchbedingungen
+ *
+ * Wird beim ersten Zugriff auf eine tagId über eine Stichprobe der aktiven DMGR_Tag ermittelt, in newDocument
+ * fortgeschrieben und neu erhoben, sobald die Zeilenzahl um die Hälfte gewachsen ist.
+ */
+class TagStatistics {
+public:
+  class Stat {
+  public:
+    size_t rows = 0;      // Anzahl aktiver Zeilen; ohne exact nur die Stichprobe
+    size_t distinct = 0;  // Anzahl verschiedener Inhalte; nach add() hochgerechnet
+    size_t rowsAtLoad = 0;
+    size_t distinctAtLoad = 0;
+    bool exact = false;   // vollständig gezählt
+    bool loaded = false;
+    bool loading = false; // wird gerade außerhalb des Mutex neu erhoben
+    std::map<std::string, size_t> frequent; // häufigste Inhalte
+  };
+  /// geschätzte Anzahl Treffer einer Suchbedingung
+  double estimate(mobs::DatabaseInterface &dbi, TagId tagId, const std::multimap<std::string, std::string> &tagOpList);
+  void add(TagId tagId, const std::string &content);
+
+private:
+  static const size_t sampleSize = 20000;
+  static const size_t frequentSize = 32;
+  void load(mobs::DatabaseInterface &dbi, TagId tagId, Stat &stat);
+
+  std::mutex mutex;
+  std::map<TagId, Stat> stats;
+};
+
+const size_t TagStatistics::sampleSize;
+const size_t TagStatistics::frequentSize;
+
+void TagStatistics::load(mobs::DatabaseInterface &dbi, TagId tagId, Stat &stat) {
+  DMGR_Tag ti;
+  using Q = mobs::QueryGenerator;
+  Q query;
+  query << Q::AndBegin << ti.active.QiEq(true) << ti.tagId.QiEq(tagId) << Q::AndEnd;
+  std::map<std::string, size_t> values;
+  size_t rows = 0;
+  auto cursor = dbi.query(ti, query);
+  for (; not cursor->eof() and rows < sampleSize; cursor->next()) {
+    dbi.retrieve(ti, cursor);
+    values[ti.content()]++;
+    rows++;
+  }
+  stat.exact = cursor->eof();
+  stat.rows = stat.rowsAtLoad = rows;
+  stat.distinct = stat.distinctAtLoad = values.size();
+  stat.loaded = true;
+  stat.loading = false;
+  // nur die häufigsten Inhalte behalten
+  std::vector<std::pair<size_t, const std::string *>> top;
+  for (auto const &v:values)
+    top.emplace_back(v.second, &v.first);
+  size_t n = std::min(top.size(), frequentSize);
+  std::partial_sort(top.begin(), top.begin() + n, top.end(),
+                    [](const std::pair<size_t, const std::string *> &a, const std::pair<size_t, const std::string *> &b) {
+                      return a.first > b.first;
+                    });
+  stat.frequent.clear();
+  for (size_t i = 0; i < n; i++)
+    stat.frequent.emplace(*top[i].second, top[i].first);
+  LOG(LM_INFO, "tag statistics " << tagId << " rows=" << stat.rows << (stat.exact ? "" : "+") << " distinct="
+                                 << stat.distinct);
+}
+
+void TagStatistics::add(TagId tagId, const std::string &content) {
+  std::lock_guard<std::mutex> guard(mutex);
+  auto it = stats.find(tagId);
+  if (it == stats.end())
+    return;
+  Stat &st = it->second;
+  st.rows++;
+  auto f = st.frequent.find(content);
+  if (f != st.frequent.end())
+    f->second++;
+  // Verhältnis von Zeilen zu Inhalten aus der Erhebung beibehalten, damit der Durchschnitt nicht wegläuft
+  if (st.rowsAtLoad)
+    st.distinct = st.distinctAtLoad + (st.rows - st.rowsAtLoad) * st.distinctAtLoad / st.rowsAtLoad;
+}
+
+double TagStatistics::estimate(mobs::DatabaseInterface &dbi, TagId tagId,
+                               const std::multimap<std::string, std::string> &tagOpList) {
+  Stat st;
+  bool reload = false;
+  {
+    std::lock_guard<std::mutex> guard(mutex);
+    auto it = stats.find(tagId);
+    if (it == stats.end()) {
+      it = stats.emplace(tagId, Stat()).first;
+      it->second.loading = true;
+      reload = true;
+    } else {
+      Stat &s = it->second;
+      // ohne Ergebnis selbst erheben, sonst während einer laufenden Erhebung mit dem alten Stand schätzen
+      reload = not s.loaded or (not s.loading and s.rows > s.rowsAtLoad + s.rowsAtLoad / 2 + 100);
+      if (reload)
+        s.loading = true;
+      else
+        st = s;
+    }
+  }
+  if (reload) {
+    // Stichprobe ohne Mutex, damit parallele Suchen nicht auf den Scan warten
+    load(dbi, tagId, st);
+    std::lock_guard<std::mutex> guard(mutex);
+    stats[tagId] = st;
+  }
+  // bei unvollständiger Stichprobe gilt der Tag als groß
+  double scale = st.exact ? 1.0 : 4.0;
+  double rows = double(st.rows) * scale;
+  if (tagOpList.empty())
+    return rows;
+  double avg = rows / double(std::max(st.distinct, size_t(1)));
+  double result = 0;
+  for (auto &s:tagOpList) {
+    if (s.second == "=") {
+      auto f = st.frequent.find(s.first);
+      result += f != st.frequent.end() ? double(f->second) * scale : avg;
+    } else if (s.second == "LIKE" or s.second == "CONTAINS") {
+      // Präfix: je Zeichen selektiver, aber nicht besser als ein Einzelwert
+      size_t len = s.second == "LIKE" ? std::min(s.first.find_first_of("%_"), s.first.length()) : s.first.length();
+      double est = rows;
+      for (size_t i = 0; i < len and est > avg; i++)
+        est /= 4;
+      result += std::max(est, avg);
+    } else if (s.second == "<" or s.second == "<=" or s.second == ">" or s.second == ">=")
+      result += rows / 3;
+    else
+      result += rows;
+  }
+  return std::min(result, rows);
+}
+
+static TagStatistics tagStatistics;
+
+/// Such-Tags (name$$) erhalten zusätzlich einen Trigramm-Index
+static bool isSearchTag(const std::string &tagName) {
+  return tagName.length() > 2 and tagName.compare(tagName.length() - 2, 2, "$$") == 0;
+}
+
+/// alle Trigramme eines Tokens
+static void trigrams(const std::string &content, std::set<std::string> &grams) {
+  for (size_t i = 0; i + 3 <= content.length(); i++)
+    grams.insert(content.substr(i, 3));
+}
+
+/** \brief Teilwortsuche über den Trigramm-Index
+ *
+ * Kandidaten sind die Dokumente, die alle Trigramme des Suchbegriffs enthalten; sie werden anschließend
+ * über DMGR_Tag mit LIKE '%content%' bestätigt. Suchbegriffe unter drei Zeichen werden nur innerhalb von within
+ * direkt über DMGR_Tag gesucht, nie über den ganzen Pool.
+ * @param within falls nicht null, Suche auf diese DocIds beschränken
+ */
+static void trigramSearch(mobs::DatabaseInterface &dbi, TagId tagId, const std::string &content,
+                          const DocIdSet *within, DocIdSet &result) {
+  using Q = mobs::QueryGenerator;
+  const size_t maxIn = 500; // DocIds je QiIn
+  DMGR_Tag ti;
+  std::set<std::string> grams;
+  trigrams(content, grams);
+  DocIdSet candidates;
+  if (not grams.empty()) {
+    bool first = true;
+    DMGR_Trigram tg;
+    for (auto &g:grams) {
+      DocIdSet ids;
+      Q query;
+      query << Q::AndBegin << tg.tagId.QiEq(tagId) << tg.gram.QiEq(g);
+      const DocIdSet *known = first ? within : &candidates;
+      if (known and known->size() < maxIn) {
+        std::list<uint64_t> l(known->begin(), known->end());
+        query << tg.docId.QiIn(l);
+      }
+      query << Q::AndEnd;
+      for (auto cursor = dbi.query(tg, query); not cursor->eof(); cursor->next()) {
+        dbi.retrieve(tg, cursor);
+        ids.push_back(tg.docId());
+      }
+      ids.normalize();
+      if (first)
+        candidates.swap(ids);
+      else
+        candidates &= ids;
+      first = false;
+      if (candidates.empty())
+        return;
+    }
+    if (within)
+      candidates &= *within;
+    LOG(LM_INFO, "TRIGRAM " << content << " " << grams.size() << " grams " << candidates.size() << " candidates");
+  } else if (within)
+    candidates = *within;
+  else
+    THROW("search term " << content << " too short");
+  // Kandidaten bestätigen
+  auto verify = [&](const std::list<uint64_t> *docs) {
+    Q query;
+    query << Q::AndBegin << ti.active.QiEq(true) << ti.tagId.QiEq(tagId) << ti.content.Qi("LIKE", "%" + content + "%");
+    if (docs)
+      query << ti.docId.QiIn(*docs);
+    query << Q::AndEnd;
+    for (auto cursor = dbi.query(ti, query); not cursor->eof(); cursor->next()) {
+      dbi.retrieve(ti, cursor);
+      result.push_back(ti.docId());
+    }
+  };
+  for (auto it = candidates.begin(); it != candidates.end();) {
+    std::list<uint64_t> l;
+    for (; it != candidates.end() and l.size() < maxIn; it++)
+      l.push_back(*it);
+    verify(&l);
+  }
+  result.normalize();
+}
+
+/// SQL-LIKE mit % und _, ohne Beachtung von Groß/Kleinschreibung (ASCII) - eher zu viele als zu wenig Treffer
+static bool likeMatch(const char *s, const char *p) {
+  for (; *p; p++, s++) {
+    if (*p == '%') {
+      while (*p == '%')
+        p++;
+      if (not *p)
+        return true;
+      for (; *s; s++)
+        if (likeMatch(s, p))
+          return true;
+      return false;
+    }
+    if (not *s)
+      return false;
+    if (*p != '_' and std::tolower(static_cast<unsigned char>(*s)) != std::tolower(static_cast<unsigned char>(*p)))
+      return false;
+  }
+  return not *s;
+}
+
+/// kann ein Tag mit diesem Inhalt die Bedingung (value, op) erfüllen; unbekannte Operatoren immer
+static bool opMatches(const std::string &content, const std::string &value, const std::string &op) {
+  if (op == "=")
+    return content == value;
+  if (op == "<")
+    return content < value;
+  if (op == "<=")
+    return content <= value;
+  if (op == ">")
+    return content > value;
+  if (op == ">=")
+    return content >= value;
+  if (op == "LIKE")
+    return likeMatch(content.c_str(), value.c_str());
+  if (op == "CONTAINS")
+    return content.find(value) != std::string::npos;
+  return true;
+}
+
+/** \brief Cache für Suchergebnisse (SearchHits) über Pool, Buckets, Gruppen-Tag und Bedingungen
+ *
+ * Begrenzt durch ein Speicherbudget, bei Überschreitung wird der am längsten nicht benutzte Eintrag verdrängt.
+ * Schreibt newDocument einen Tag, der eine Bedingung eines Eintrags erfüllen kann, oder dessen Gruppen-Tag,
+ * wird der Eintrag verworfen; neue Tag-Ids verwerfen alle Einträge. Änderungen anderer Server-Prozesse werden
+ * nicht gesehen.
+ */
+class SearchCache {
+public:
+  static std::string makeKey(const std::string &pool, const std::map<std::string, TagSearch> &searchList,
+                             const std::set<int> &buckets, const std::string &groupName);
+  void setLimit(size_t bytes);
+  bool enabled() const { return limit > 0; }
+  /// Generation für put; ändert sich bei jeder Invalidierung
+  uint64_t generation();
+  bool get(const std::string &key, SearchHits &hits);
+  /** \brief Eintrag speichern, wenn seit generation nichts invalidiert wurde
+   *
+   * @param conditions TagIds aller Buckets mit dem Schlüssel der Bedingung in searchList
+   */
+  void put(const std::string &key, const SearchHits &hits, const std::map<std::string, TagSearch> &searchList,
+           const std::multimap<TagId, std::string> &conditions, uint64_t generation);
+  /// Tags eines neuen Dokuments
+  void invalidate(const std::list<DMGR_Tag> &tags);
+  void clear();
+  SearchCacheStats stats();
+
+private:
+  class Entry {
+  public:
+    SearchHits hits;
+    std::map<std::string, TagSearch> searchList;
+    std::multimap<TagId, std::string> conditions; // TagId -> Schlüssel in searchList
+    size_t size = 0;
+    std::list<std::string>::iterator lru;
+  };
+  void erase(std::map<std::string, Entry>::iterator it);
+
+  std::mutex mutex;
+  size_t limit = 0;
+  size_t memory = 0;
+  uint64_t gen = 0;
+  std::map<std::string, Entry> entries;
+  std::list<std::string> lru; // zuletzt benutzt vorne
+  size_t hits = 0;
+  size_t misses = 0;
+  size_t invalidations = 0;
+  size_t evictions = 0;
+};
+
+std::string SearchCache::makeKey(const std::string &pool, const std::map<std::string, TagSearch> &searchList,
+                                 const std::set<int> &buckets, const std::string &groupName) {
+  const char sep = '\x1f';
+  std::string key = pool;
+  key += sep;
+  for (auto b:buckets) {
+    key += std::to_string(b);
+    key += ',';
+  }
+  key += sep;
+  key += groupName;
+  for (auto &i:searchList) {
+    key += sep;
+    key += i.first;
+    key += sep;
+    key += i.second.tagName;
+    key += i.second.primary ? "+P" : "";
+    // gleiche Inhalte können in beliebiger Reihenfolge eingetragen sein
+    std::vector<std::pair<std::string, std::string>> ops(i.second.tagOpList.begin(), i.second.tagOpList.end());
+    std::sort(ops.begin(), ops.end());
+    for (auto &o:ops) {
+      key += sep;
+      key += o.second;
+      key += ' ';
+      key += o.first;
+    }
+  }
+  return key;
+}
+
+void SearchCache::setLimit(size_t bytes) {
+  std::lock_guard<std::mutex> guard(mutex);
+  limit = bytes;
+}
+
+uint64_t SearchCache::generation() {
+  std::lock_guard<std::mutex> guard(mutex);
+  return gen;
+}
+
+bool SearchCache::get(const std::string &key, SearchHits &result) {
+  std::lock_guard<std::mutex> guard(mutex);
+  auto it = entries.find(key);
+  if (it == entries.end()) {
+    misses++;
+    return false;
+  }
+  hits++;
+  lru.splice(lru.begin(), lru, it->second.lru);
+  result = it->second.hits;
+  return true;
+}
+
+void SearchCache::put(const std::string &key, const SearchHits &result,
+                      const std::map<std::string, TagSearch> &searchList,
+                      const std::multimap<TagId, std::string> &conditions, uint64_t generation) {
+  size_t sz = key.length() + 256 + (result.docIds.size() + result.primIds.size()) * sizeof(DocId);
+  std::lock_guard<std::mutex> guard(mutex);
+  if (gen != generation or sz > limit)
+    return;
+  auto old = entries.find(key);
+  if (old != entries.end())
+    erase(old);
+  Entry &e = entries[key];
+  e.hits = result;
+  e.searchList = searchList;
+  e.conditions = conditions;
+  e.size = sz;
+  lru.push_front(key);
+  e.lru = lru.begin();
+  memory += sz;
+  while (memory > limit and not lru.empty()) {
+    evictions++;
+    erase(entries.find(lru.back()));
+  }
+}
+
+void SearchCache::erase(std::map<std::string, Entry>::iterator it) {
+  memory -= std::min(memory, it->second.size);
+  lru.erase(it->second.lru);
+  entries.erase(it);
+}
+
+void SearchCache::invalidate(const std::list<DMGR_Tag> &tags) {
+  std::lock_guard<std::mutex> guard(mutex);
+  gen++; // laufende Suchen dürfen ihr Ergebnis nicht mehr speichern
+  if (entries.empty())
+    return;
+  for (auto it = entries.begin(); it != entries.end();) {
+    const Entry &e = it->second;
+    bool match = false;
+    for (auto &t:tags) {
+      if (e.hits.groupId and t.tagId() == e.hits.groupId) { // Gruppe könnte wachsen
+        match = true;
+        break;
+      }
+      auto range = e.conditions.equal_range(t.tagId());
+      for (auto c = range.first; c != range.second and not match; c++) {
+        auto &ops = e.searchList.find(c->second)->second.tagOpList;
+        if (ops.empty())
+          match = true;
+        for (auto &o:ops)
+          if (opMatches(t.content(), o.first, o.second)) {
+            match = true;
+            break;
+          }
+      }
+      if (match)
+        break;
+    }
+    if (match) {
+      invalidations++;
+      auto del = it++;
+      erase(del);
+    } else
+      it++;
+  }
+}
+
+void SearchCache::clear() {
+  std::lock_guard<std::mutex> guard(mutex);
+  if (not entries.empty())
+    invalidations += entries.size();
+  entries.clear();
+  lru.clear();
+  memory = 0;
+  gen++;
+}
+
+SearchCacheStats SearchCache::stats() {
+  std::lock_guard<std::mutex> guard(mutex);
+  SearchCacheStats st;
+  st.hits = hits;
+  st.misses = misses;
+  st.invalidations = invalidations;
+  st.evictions = evictions;
+  st.entries = entries.size();
+  st.memory = memory;
+  return st;
+}
+
+static SearchCache searchCache;
+
+/// Gruppen-Tag bei Bedarf in den GroupIndex laden; false, wenn der Index nicht verwendet werden kann
+static bool groupIndexReady(mobs::DatabaseInterface &dbi, TagId groupId) {
+  GroupIndex &groupIndex = GroupIndex::instance();
+  if (not groupIndex.enabled())
+    return false;
+  if (groupIndex.loaded(groupId))
+    return true;
+  if (not groupIndex.beginLoad(groupId)) // lädt gerade ein anderer Thread
+    return false;
+  try {
+    std::chrono::system_clock::time_point begin = std::chrono::system_clock::now();
+    std::vector<std::pair<std::string, uint64_t>> entries;
+    DMGR_Tag tg;
+    using Q = mobs::QueryGenerator;
+    Q query;
+    query << Q::AndBegin << tg.active.QiEq(true) << tg.tagId.QiEq(groupId) << Q::AndEnd;
+    for (auto cursor = dbi.query(tg, query); not cursor->eof(); cursor->next()) {
+      dbi.retrieve(tg, cursor);
+      entries.emplace_back(tg.content(), tg.docId());
+    }
+    groupIndex.finishLoad(groupId, entries);
+    std::chrono::system_clock::time_point now = std::chrono::system_clock::now();
+    LOG(LM_INFO, "group index " << groupId << " " << entries.size() << " entries TIME "
+                                << std::chrono::duration_cast<std::chrono::milliseconds>(now - begin).count());
+  } catch (...) {
+    groupIndex.abortLoad(groupId);
+    throw;
+  }
+  return true;
+}
+
+/// Schritt des Suchplans in Filestore::searchHits
+class PlanStep {
+public:
+  PlanStep(double c, TagId id, const std::pair<const std::string, TagSearch> *e) : cost(c), tagId(id), entry(e) {}
+  bool operator<(const PlanStep &other) const { return cost < other.cost; }
+  double cost;
+  TagId tagId;
+  const std::pair<const std::string, TagSearch> *entry;
+};
+
+/// Ergebnis der Suche in einem Bucket
+class BucketHits {
+public:
+  DocIdSet matched; // Treffer der Bedingungen
+  DocIdSet docIds;  // Treffer inkl. Gruppen-Erweiterung
+  bool primaryEmpty = false; // Primärsuche ohne Treffer -> gesamte Suche leer
+};
+
+/** \brief Thread-Pool für die Auswertung einzelner Buckets
+ *
+ * Jeder Thread hat seine eigene Datenbank-Verbindung, deren Name der Task übergeben wird.
+ */
+class SearchPool {
+public:
+  using Task = std::packaged_task<void(const std::string &)>;
+
+  static SearchPool &instance() {
+    // wird nie zerstört, da die Threads bis zum Prozessende auf Tasks warten
+    static SearchPool *searchPool = new SearchPool;
+    return *searchPool;
+  }
+  void start(size_t threads) {
+    std::lock_guard<std::mutex> guard(mutex);
+    for (size_t i = running; i < threads; i++) {
+      std::string con = "docsrch";
+      con += std::to_string(i);
+      Filestore::newDbInstance(con);
+      std::thread t(&SearchPool::run, this, con);
+      t.detach();
+    }
+    if (threads > running)
+      running = threads;
+  }
+  size_t size() {
+    std::lock_guard<std::mutex> guard(mutex);
+    return running;
+  }
+  std::future<void> submit(std::function<void(const std::string &)> f) {
+    Task task(std::move(f));
+    auto result = task.get_future();
+    {
+      std::lock_guard<std::mutex> guard(mutex);
+      tasks.push_back(std::move(task));
+    }
+    cv.notify_one();
+    return result;
+  }
+
+private:
+  void run(std::string con) {
+    for (;;) {
+      Task task;
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        cv.wait(lock, [this]() { return not tasks.empty(); });
+        task = std::move(tasks.front());
+        tasks.pop_front();
+      }
+      task(con); // Exceptions landen im future
+    }
+  }
+
+  std::mutex mutex;
+  std::condition_variable cv;
+  std::deque<Task> tasks;
+  size_t running = 0;
+};
+
 
 
 void Filestore::setBase(const std::string &basedir, bool genkey) {
@@ -178,6 +888,10 @@ void Filestore::setBase(const std::string &basedir, bool genkey) {
   dbi.structure(p);
   dbi.structure(tp);
   dbi.structure(bp);
+  DMGR_Trigram tg;
+  dbi.structure(tg);
+
+  tagDictionary.load(dbi);
 
   if (not genkey and dbi.load(sk)) {
     pub = sk.pubkey();
@@ -192,6 +906,81 @@ void Filestore::setBase(const std::string &basedir, bool genkey) {
   }
 }
 
+void Filestore::buildTagIndex() {
+  LOG(LM_INFO, "build tag index");
+  std::chrono::system_clock::time_point begin = std::chrono::system_clock::now();
+  auto dbi = mobs::DatabaseManager::instance()->getDbIfc(conName);
+  TagIndex &tagIndex = TagIndex::instance();
+  DMGR_Tag ti;
+  using Q = mobs::QueryGenerator;
+  Q query;
+  query << ti.active.QiEq(true);
+  size_t cnt = 0;
+  for (auto cursor = dbi.query(ti, query); not cursor->eof(); cursor->next()) {
+    dbi.retrieve(ti, cursor);
+    tagIndex.add(ti.tagId(), ti.content(), ti.docId());
+    cnt++;
+  }
+  tagIndex.enable();
+  GroupIndex::instance().enable(); // Gruppen-Tags werden bei Bedarf geladen
+  std::chrono::system_clock::time_point now = std::chrono::system_clock::now();
+  LOG(LM_INFO, "tag index " << cnt << " tags " << tagIndex.entries() << " entries TIME "
+                            << std::chrono::duration_cast<std::chrono::milliseconds>(now - begin).count());
+}
+
+void Filestore::rebuildTrigramIndex() {
+  LOG(LM_INFO, "rebuild trigram index");
+  std::chrono::system_clock::time_point begin = std::chrono::system_clock::now();
+  auto dbi = mobs::DatabaseManager::instance()->getDbIfc(conName);
+  // Postings deaktivierter Tags und früherer Läufe verwerfen
+  DMGR_Trigram tg;
+  dbi.dropAll(tg);
+  dbi.structure(tg);
+  std::map<TagId, bool> searchTags;
+  DMGR_Tag ti;
+  using Q = mobs::QueryGenerator;
+  Q query;
+  query << ti.active.QiEq(true);
+  size_t cnt = 0;
+  size_t grams = 0;
+  const size_t batchSize = 1000;
+  std::list<DMGR_Trigram> gramList;
+  // je Block eine Transaktion, wie in newDocument
+  auto flush = [&dbi, &gramList]() {
+    mobs::DatabaseManager::execute([&dbi, &gramList](mobs::DbTransaction *trans) {
+      auto dbt = trans->getDbIfc(dbi);
+      for (auto &g:gramList)
+        dbt.save(g);
+    });
+    gramList.clear();
+  };
+  for (auto cursor = dbi.query(ti, query); not cursor->eof(); cursor->next()) {
+    dbi.retrieve(ti, cursor);
+    auto it = searchTags.find(ti.tagId());
+    if (it == searchTags.end())
+      it = searchTags.emplace(ti.tagId(), isSearchTag(tagName(ti.tagId()))).first;
+    if (not it->second)
+      continue;
+    std::set<std::string> g;
+    trigrams(ti.content(), g);
+    for (auto &i:g) {
+      gramList.emplace_back();
+      gramList.back().tagId(ti.tagId());
+      gramList.back().gram(i);
+      gramList.back().docId(ti.docId());
+    }
+    grams += g.size();
+    cnt++;
+    if (gramList.size() >= batchSize)
+      flush();
+  }
+  if (not gramList.empty())
+    flush();
+  std::chrono::system_clock::time_point now = std::chrono::system_clock::now();
+  LOG(LM_INFO, "trigram index " << cnt << " tags " << grams << " grams TIME "
+                                << std::chrono::duration_cast<std::chrono::milliseconds>(now - begin).count());
+}
+
 void Filestore::newDbInstance(const std::string &con) {
   std::string dbname;
   std::string db = "sqlite://";
@@ -223,18 +1012,8 @@ std::string Filestore::priv;
 void Filestore::newDocument(DocInfo &doc, const std::list<TagInfo> &tags, int groupId) {
   LOG(LM_INFO, "newDocument ");
   auto dbi = mobs::DatabaseManager::instance()->getDbIfc(conName);
-  static DMGR_Counter cntr;
-  static std::mutex mutex;
-  {
-    std::lock_guard<std::mutex> guard(mutex);
-    if (cntr.id() != DMGR_Counter::CntrDocument) {
-      cntr.id(DMGR_Counter::CntrDocument);
-      dbi.load(cntr);
-    }
-    dbi.save(cntr);
-  }
 
-  doc.id = cntr.counter();
+  doc.id = idsDocument.next(dbi);
   doc.supersedeId = 0;
   doc.insertTime = mobs::MTimeNow();
   if (doc.creation == mobs::MTime{})
@@ -250,52 +1029,56 @@ void Filestore::newDocument(DocInfo &doc, const std::list<TagInfo> &tags, int gr
   dbd.creator(doc.creator);
   dbd.creationInfo(doc.creationInfo);
 
-  dbi.save(dbd);
-
-  std::list<uint64_t> docs;
+  std::vector<uint64_t> docs;
+  bool useIndex = false; // Gruppe und vorhandene Tags aus GroupIndex und TagIndex statt aus der DB
   if (groupId) { // Bei groupId Tags die auf selbe groupId verweisen weglassen, außer group-Tag selbst
     std::string group;
     for (auto &t:tags) {
       if (t.tagId == groupId)
         group = t.tagContent;
     }
-    DMGR_Tag tg;
-    tg.content(group);
-    tg.tagId(groupId);
-    tg.active(true);
-    for (auto cursor = dbi.qbe(tg); not cursor->eof(); cursor->next()) {
-      dbi.retrieve(tg, cursor);
-      docs.emplace_back(tg.docId());
+    if (groupIndexReady(dbi, groupId) and GroupIndex::instance().members(groupId, group, docs))
+      useIndex = TagIndex::instance().enabled();
+    else {
+      DMGR_Tag tg;
+      tg.content(group);
+      tg.tagId(groupId);
+      tg.active(true);
+      for (auto cursor = dbi.qbe(tg); not cursor->eof(); cursor->next()) {
+        dbi.retrieve(tg, cursor);
+        docs.emplace_back(tg.docId());
+      }
     }
     LOG(LM_INFO, "group " << group << " found " << docs.size() << " documents");
     if (docs.empty())
       groupId = 0;
   }
 
+  std::list<uint64_t> docList;
+  if (groupId and not useIndex)
+    docList.assign(docs.begin(), docs.end());
+  std::list<DMGR_Tag> tagList;
+  std::list<DMGR_Trigram> gramList;
   for (auto &t:tags) {
-    if (groupId and t.tagId != groupId) {
+    if (groupId and t.tagId != groupId and useIndex) {
+      if (TagIndex::instance().containsAny(t.tagId, t.tagContent, docs)) {
+        LOG(LM_INFO, "tag " << t.tagId << " " << t.tagContent << " already exists - skip");
+        continue;
+      }
+    } else if (groupId and t.tagId != groupId) {
       DMGR_Tag ts;
       using Q = mobs::QueryGenerator;
       Q query;
       query << Q::AndBegin << ts.active.QiEq(true) << ts.tagId.QiEq(t.tagId) << ts.content.QiEq(t.tagContent)
-            << ts.docId.QiIn(docs) << Q::AndEnd;
+            << ts.docId.QiIn(docList) << Q::AndEnd;
       if (not dbi.query(ts, query)->eof()) {
         LOG(LM_INFO, "tag " << t.tagId << " " << t.tagContent << " already exists - skip");
         continue;
       }
     }
-    static DMGR_Counter cntr;
-    static std::mutex mutex;
-    {
-      std::lock_guard<std::mutex> guard(mutex);
-      if (cntr.id() != DMGR_Counter::CntrTag) {
-        cntr.id(DMGR_Counter::CntrTag);
-        dbi.load(cntr);
-      }
-      dbi.save(cntr);
-    }
-    DMGR_Tag ti;
-    ti.id(cntr.counter());
+    tagList.emplace_back();
+    DMGR_Tag &ti = tagList.back();
+    ti.id(idsTag.next(dbi));
     ti.active(true);
     ti.tagId(t.tagId);
     ti.docId(doc.id);
@@ -303,8 +1086,39 @@ void Filestore::newDocument(DocInfo &doc, const std::list<TagInfo> &tags, int gr
     ti.creation(doc.creation);
     ti.creator(doc.creator);
     ti.insertTime(doc.insertTime);
-    LOG(LM_INFO, "SAVE " << ti.to_string());
-    dbi.save(ti);
+    LOG(LM_DEBUG, "SAVE " << ti.to_string());
+    if (isSearchTag(tagName(t.tagId))) {
+      std::set<std::string> grams;
+      trigrams(t.tagContent, grams);
+      for (auto &g:grams) {
+        gramList.emplace_back();
+        gramList.back().tagId(t.tagId);
+        gramList.back().gram(g);
+        gramList.back().docId(doc.id);
+      }
+    }
+  }
+
+  // Dokument und alle Tags in einer Transaktion schreiben
+  mobs::DatabaseManager::execute([&dbi, &dbd, &tagList, &gramList](mobs::DbTransaction *trans) {
+    auto dbt = trans->getDbIfc(dbi);
+    dbt.save(dbd);
+    for (auto &ti:tagList)
+      dbt.save(ti);
+    for (auto &tg:gramList)
+      dbt.save(tg);
+  });
+  LOG(LM_INFO, "newDocument " << doc.id << " " << tagList.size() << " tags saved");
+  for (auto &ti:tagList)
+    tagStatistics.add(ti.tagId(), ti.content());
+  searchCache.invalidate(tagList);
+  if (TagIndex::instance().enabled()) {
+    for (auto &ti:tagList)
+      TagIndex::instance().add(ti.tagId(), ti.content(), ti.docId());
+  }
+  if (GroupIndex::instance().enabled()) {
+    for (auto &ti:tagList)
+      GroupIndex::instance().add(ti.tagId(), ti.content(), ti.docId());
   }
 }
 
@@ -387,11 +1201,7 @@ int Filestore::findBucket(const std::string &pool, const std::vector<std::string
   auto cursor = dbi.qbe(binfo);
   if (cursor->eof()) {
     // neuen Tag anlegen
-    DMGR_Counter cntr;
-    cntr.id(DMGR_Counter::CntrBucketInfo);
-    dbi.load(cntr);
-    dbi.save(cntr);
-    binfo.id(int(cntr.counter()));
+    binfo.id(int(idsBucketInfo.next(dbi)));
     if (binfo.id() == 0)
       THROW("BucketId should not be 0");
     dbi.save(binfo);
@@ -407,119 +1217,134 @@ int Filestore::findBucket(const std::string &pool, const std::vector<std::string
 void Filestore::insertTag(std::list<TagInfo> &tags, const std::string &pool, const std::string &tagName,
                           const std::string &content, int bucket) {
   LOG(LM_INFO, "insertTag " << tagName << "[" << bucket << "] " << content);
-  auto dbi = mobs::DatabaseManager::instance()->getDbIfc(conName);
-  DMGR_TagInfo tpool;
-  tpool.pool(pool);
-  tpool.name(tagName);
-  tpool.bucket(bucket);
-  auto cursor = dbi.qbe(tpool);
-  if (cursor->eof()) {
-    // neuen Tag anlegen
-    DMGR_Counter cntr;
-    cntr.id(DMGR_Counter::CntrTagPool);
-    dbi.load(cntr);
-    dbi.save(cntr);
-    tpool.id(cntr.counter());
-    dbi.save(tpool);
+  TagId id = tagDictionary.find(pool, tagName, bucket);
+  if (not id) {
+    auto dbi = mobs::DatabaseManager::instance()->getDbIfc(conName);
+    DMGR_TagInfo tpool;
+    tpool.pool(pool);
+    tpool.name(tagName);
+    tpool.bucket(bucket);
+    auto cursor = dbi.qbe(tpool);
+    if (cursor->eof()) {
+      // neuen Tag anlegen
+      tpool.id(int(idsTagPool.next(dbi)));
+      dbi.save(tpool);
+      searchCache.clear(); // Einträge kennen die neue TagId nicht
+    } else {
+      // Tag bereits bekannt
+      dbi.retrieve(tpool, cursor);
+    }
+    tagDictionary.insert(tpool);
+    id = tpool.id();
   }
-  else {
-    // Tag bereits bekannt
-    dbi.retrieve(tpool, cursor);
 #ifdef KEINE_MEHRFACHEN_TAGS
-    for (auto &t:tags) {
-      if (t.tagId == tpool.id()) {
-        t.tagContent = content;
-        return;
-      }
+  for (auto &t:tags) {
+    if (t.tagId == id) {
+      t.tagContent = content;
+      return;
     }
-#endif
   }
-  tags.emplace_back(tpool.id(), content);
+#endif
+  tags.emplace_back(id, content);
 }
 
 
 TagId Filestore::findTag(const std::string &pool, const std::string &tagName, int bucket) {
   LOG(LM_INFO, "findTag " << tagName);
+  TagId id = tagDictionary.find(pool, tagName, bucket);
+  if (id)
+    return id;
+  // das Verzeichnis ist vollständig, nur Tags anderer Server-Prozesse können fehlen
   auto dbi = mobs::DatabaseManager::instance()->getDbIfc(conName);
-  DMGR_TagInfo tpool;
-  tpool.pool(pool);
-  tpool.name(tagName);
-  tpool.bucket(bucket);
-  auto cursor = dbi.qbe(tpool);
-  if (cursor->eof()) {
-    return 0;
-  }
-  else {
-    // Tag bereits bekannt
-    dbi.retrieve(tpool, cursor);
-    return tpool.id();
-  }
-  return 0;
+  if (tagDictionary.refresh(dbi))
+    id = tagDictionary.find(pool, tagName, bucket);
+  return id;
 }
 
 std::string Filestore::tagName(TagId id) {
   std::string result;
-  auto dbi = mobs::DatabaseManager::instance()->getDbIfc(conName);
-  DMGR_TagInfo tpool;
-  tpool.id(id);
-  auto cursor = dbi.qbe(tpool);
-  if (not cursor->eof()) {
-    // Tag bereits bekannt
-    dbi.retrieve(tpool, cursor);
-    result = tpool.name();
+  if (not tagDictionary.name(id, result)) {
+    auto dbi = mobs::DatabaseManager::instance()->getDbIfc(conName);
+    if (tagDictionary.refresh(dbi))
+      tagDictionary.name(id, result);
   }
-  LOG(LM_INFO, "tagName " << id << "->" << result);
+  LOG(LM_DEBUG, "tagName " << id << "->" << result);
   return result;
 }
 
 
-std::list<SearchResult>
-Filestore::searchTags(const std::string &pool, const std::map<std::string, TagSearch> &searchList,
-                      const std::set<int> &buckets, const std::string &groupName, std::function<void (int)> ckFun) {
-  LOG(LM_INFO, "search ");
+void Filestore::setSearchThreads(size_t threads) {
+  SearchPool::instance().start(threads);
+}
+
+void Filestore::searchBucket(const std::string &pool, const std::map<std::string, TagSearch> &searchList,
+                             int bucket, size_t numBuckets, TagId groupId, const std::string &groupName,
+                             const CancelToken &cancel, const std::function<void()> &tick, BucketHits &result) {
   std::chrono::system_clock::time_point begin = std::chrono::system_clock::now();
   std::chrono::system_clock::time_point now;
-  std::list<SearchResult> result;
-  TagId groupId = 0;
-  if (not groupName.empty())
-    groupId = findTag(pool, groupName);
-
   auto dbi = mobs::DatabaseManager::instance()->getDbIfc(conName);
   DMGR_Tag ti;
 
   using Q = mobs::QueryGenerator;    // Erleichtert die Tipp-Arbeit
 
-  std::list<uint64_t> docList;
-  std::set<uint64_t> docIdsPrim; // Ids der Primary muss mit allen anderen Buckets eine Schnittmenge bilden
-  int cnt = 0;
-  int maxCnt = buckets.size();
-  for (auto bucket:buckets) {
-    LOG(LM_INFO, "SEARCH BUCKET " << bucket);
-    // pro SearchList-Eintrag (tag) eine Query und Schnittmenge aus Ergebnissen bilden
-    std::set<uint64_t> docIds;
-    bool start = true;
-    bool startPrim = true;
-    for (auto &i:searchList) {
-      if (i.second.primary and bucket != 0) // only 0 allowed
+  LOG(LM_INFO, "SEARCH BUCKET " << bucket);
+  // pro SearchList-Eintrag (tag) eine Query und Schnittmenge aus Ergebnissen bilden
+  DocIdSet &docIds = result.docIds;
+  DocIdSet docIdsPrim; // Ids der Primary muss mit allen anderen Buckets eine Schnittmenge bilden
+  bool start = true;
+  bool startPrim = true;
+  // Planer: Einträge nach geschätzter Trefferzahl ordnen, damit die selektivste Bedingung zuerst läuft
+  // und ihre DocIds in die folgenden Queries übernommen werden können
+  std::vector<PlanStep> plan;
+  for (auto &i:searchList) {
+    if (i.second.primary and bucket != 0) // only 0 allowed
+      continue;
+    TagId id = findTag(pool, i.second.tagName, bucket);
+    if (id <= 0) {
+      LOG(LM_INFO, "no data for " << i.second.tagName << "[" << bucket << "] ");
+      if (bucket == 0 and not i.second.primary and numBuckets > 1)
         continue;
-      TagId id = findTag(pool, i.second.tagName, bucket);
-      if (id <= 0) {
-        LOG(LM_INFO, "no data for " << i.second.tagName << "[" << bucket << "] ");
-        if (bucket == 0 and not i.second.primary and buckets.size() > 1)
-          continue;
-        break;
+      plan.clear(); // Tag in diesem Bucket unbekannt -> keine Treffer
+      break;
+    }
+    plan.emplace_back(tagStatistics.estimate(dbi, id, i.second.tagOpList), id, &i);
+  }
+  std::stable_sort(plan.begin(), plan.end());
+  for (auto &p:plan) {
+    if (cancel.canceled())
+      return;
+    auto &i = *p.entry;
+    TagId id = p.tagId;
+//    if (i.first.length() > 3 and i.first.[i.first.length()-1] == '$')
+//      dontReturn.insert(id);
+    LOG(LM_INFO, "SEARCH: " << i.second.tagName << "[" << bucket << "] " << id << " prim=" << i.second.primary
+                            << " est=" << p.cost);
+    DocIdSet docIdsTmp;
+    DocIdSet docIdsPrimTmp;
+    docIdsTmp.swap(docIds);
+    if (i.second.primary)
+      docIdsPrimTmp.swap(docIdsPrim);
+    DocIdSet termIds; // Treffer dieses Eintrags
+    DocBitmap bitmap;
+    bool contains = not i.second.tagOpList.empty();
+    for (auto &s:i.second.tagOpList)
+      if (s.second != "CONTAINS")
+        contains = false;
+    if (contains) {
+      for (auto &s:i.second.tagOpList) {
+        DocIdSet ids;
+        trigramSearch(dbi, id, s.first, start or i.second.primary ? nullptr : &docIdsTmp, ids);
+        termIds |= ids;
       }
-//      if (i.first.length() > 3 and i.first.[i.first.length()-1] == '$')
-//        dontReturn.insert(id);
-      LOG(LM_INFO, "SEARCH: " << i.second.tagName << "[" << bucket << "] " << id << " prim=" << i.second.primary);
-      std::set<uint64_t> docIdsTmp;
-      std::set<uint64_t> docIdsPrimTmp;
-      if (start and bucket and not docIdsPrim.empty())  // bei buckets > 0 mit Primary vorinitialisieren
-        docIdsTmp = docIdsPrim;
-      else
-        docIdsTmp.swap(docIds);
-      if (i.second.primary)
-        docIdsPrimTmp.swap(docIdsPrim);
+      if (tick)
+        tick();
+    } else if (TagIndex::instance().enabled() and TagIndex::instance().search(id, i.second.tagOpList, bitmap)) {
+      LOG(LM_INFO, "INDEX " << bitmap.size());
+      if (tick)
+        tick();
+      termIds.reserve(bitmap.size());
+      bitmap.forEach([&termIds](uint64_t docId) { termIds.push_back(docId); });
+    } else {
       Q query;
       query << Q::AndBegin << ti.active.Qi("=", true) << ti.tagId.Qi("=", id);
       if (not i.second.tagOpList.empty()) {
@@ -561,98 +1386,366 @@ Filestore::searchTags(const std::string &pool, const std::map<std::string, TagSe
       now = std::chrono::system_clock::now();
       LOG(LM_INFO, "TIME " << std::chrono::duration_cast<std::chrono::milliseconds>(now - begin).count());
       while (not cursor->eof()) {
-        ckFun(80 * cnt / maxCnt);
-//        usleep(50000);
+        if (cancel.canceled())
+          return;
+        if (tick)
+          tick();
         dbi.retrieve(ti, cursor);
         LOG(LM_DEBUG, "Z " << ti.to_string());
-        // Schnittmenge aller sets bilden
-        if (start or docIdsTmp.find(ti.docId()) != docIdsTmp.end())
-          docIds.emplace(ti.docId());
-        if (i.second.primary) { // only bucket 0
-          if (startPrim or docIdsPrimTmp.find(ti.docId()) != docIdsPrimTmp.end())
-            docIdsPrim.emplace(ti.docId());
-        }
+        termIds.push_back(ti.docId());
         cursor->next();
       }
-      now = std::chrono::system_clock::now();
-      LOG(LM_INFO, "TIME " << std::chrono::duration_cast<std::chrono::milliseconds>(now - begin).count());
-      start = false;
-      LOG(LM_INFO, "QSIZE " << docIds.size() << " " << cursor->pos() << " " << docIdsPrim.size());
-      if (i.second.primary) {
-        startPrim = false;
-        if (docIdsPrim.empty()) {
-          LOG(LM_INFO, "empty primary search " << i.first);
-          return result;
-        }
-      }
-      if (docIds.empty()) {
-        LOG(LM_INFO, "empty bucket result at " << i.first);
-        break;
-      }
     }
-    docIdsPrim = docIds;
-    if (groupId and not docIds.empty()) { // collect all docs with same groupId
-      DMGR_Tag tig;
-      std::list<uint64_t> l(docIds.begin(), docIds.end());
-      std::list<std::string> groupIds;
-      LOG(LM_INFO, "collect via groupId " << groupName << " from " << l.size() << " documents");
-      Q queryG1;
-      queryG1 << Q::AndBegin << tig.active.QiEq( true) << tig.tagId.QiEq(groupId) << tig.docId.QiIn(l) << Q::AndEnd;
-      for (auto cursor = dbi.query(tig, queryG1); not cursor->eof(); cursor->next()) {
-        dbi.retrieve(tig, cursor);
-        groupIds.emplace_back(tig.content());
+    termIds.normalize();
+    // Schnittmenge aller sets bilden
+    if (i.second.primary) { // only bucket 0
+      if (startPrim)
+        docIdsPrim = termIds;
+      else
+        DocIdSet::intersect(docIdsPrimTmp, termIds, docIdsPrim);
+    }
+    if (start)
+      docIds.swap(termIds);
+    else
+      DocIdSet::intersect(docIdsTmp, termIds, docIds);
+    LOG(LM_INFO, "QSIZE " << docIds.size() << " " << docIdsPrim.size());
+    now = std::chrono::system_clock::now();
+    LOG(LM_INFO, "TIME " << std::chrono::duration_cast<std::chrono::milliseconds>(now - begin).count());
+    start = false;
+    if (i.second.primary) {
+      startPrim = false;
+      if (docIdsPrim.empty()) {
+        LOG(LM_INFO, "empty primary search " << i.first);
+        result.primaryEmpty = true;
+        return;
       }
-      LOG(LM_INFO, "expand via groupId " << groupName << " from " << groupIds.size() << " groupIds");
-      Q queryG2;
-      queryG2 << Q::AndBegin << tig.active.QiEq( true) << tig.tagId.QiEq(groupId) << tig.content.QiIn(groupIds) << Q::AndEnd;
-      for (auto cursor = dbi.query(tig, queryG2); not cursor->eof(); cursor->next()) {
-        dbi.retrieve(tig, cursor);
-        docIds.insert(tig.docId());
+    }
+    if (docIds.empty()) {
+      LOG(LM_INFO, "empty bucket result at " << i.first);
+      break;
+    }
+  }
+  result.matched = docIds;
+  if (groupId and not docIds.empty() and groupIndexReady(dbi, groupId) and
+      GroupIndex::instance().expand(groupId, result.matched, docIds)) {
+    LOG(LM_INFO, "expand via group index " << groupName << " from " << result.matched.size() << " documents");
+    docIds.normalize();
+  } else if (groupId and not docIds.empty()) { // collect all docs with same groupId
+    DMGR_Tag tig;
+    std::list<uint64_t> l(docIds.begin(), docIds.end());
+    std::list<std::string> groupIds;
+    LOG(LM_INFO, "collect via groupId " << groupName << " from " << l.size() << " documents");
+    Q queryG1;
+    queryG1 << Q::AndBegin << tig.active.QiEq( true) << tig.tagId.QiEq(groupId) << tig.docId.QiIn(l) << Q::AndEnd;
+    for (auto cursor = dbi.query(tig, queryG1); not cursor->eof(); cursor->next()) {
+      dbi.retrieve(tig, cursor);
+      groupIds.emplace_back(tig.content());
+    }
+    LOG(LM_INFO, "expand via groupId " << groupName << " from " << groupIds.size() << " groupIds");
+    Q queryG2;
+    queryG2 << Q::AndBegin << tig.active.QiEq( true) << tig.tagId.QiEq(groupId) << tig.content.QiIn(groupIds) << Q::AndEnd;
+    for (auto cursor = dbi.query(tig, queryG2); not cursor->eof(); cursor->next()) {
+      dbi.retrieve(tig, cursor);
+      docIds.push_back(tig.docId());
+    }
+    docIds.normalize();
+    now = std::chrono::system_clock::now();
+    LOG(LM_INFO, "TIME " << std::chrono::duration_cast<std::chrono::milliseconds>(now - begin).count());
+  }
+}
+
+void Filestore::searchHits(const std::string &pool, const std::map<std::string, TagSearch> &searchList,
+                           const std::set<int> &buckets, const std::string &groupName, std::function<void (int)> ckFun,
+                           const CancelToken &cancel, SearchHits &hits) {
+  LOG(LM_INFO, "search ");
+  std::chrono::system_clock::time_point begin = std::chrono::system_clock::now();
+  std::chrono::system_clock::time_point now;
+  hits.docIds.clear();
+  hits.primIds.clear();
+  TagId groupId = 0;
+  if (not groupName.empty())
+    groupId = findTag(pool, groupName);
+  hits.groupId = groupId;
+  hits.pool = pool;
+  hits.buckets = buckets;
+
+  std::string cacheKey;
+  uint64_t cacheGen = 0;
+  if (searchCache.enabled()) {
+    cacheKey = SearchCache::makeKey(pool, searchList, buckets, groupName);
+    cacheGen = searchCache.generation();
+    if (searchCache.get(cacheKey, hits)) {
+      LOG(LM_INFO, "search cache hit " << hits.docIds.size() << " documents");
+      return;
+    }
+  }
+
+  int cnt = 0;
+  int maxCnt = buckets.size();
+  size_t numBuckets = buckets.size();
+  std::vector<BucketHits> results(numBuckets);
+  CancelToken stop(&cancel); // beendet auch die übrigen Buckets, wenn die Primärsuche leer ist
+  if (numBuckets > 1 and SearchPool::instance().size() > 0) {
+    // Buckets unabhängig voneinander im Pool auswerten, jeder Task mit eigener DB-Verbindung
+    std::vector<std::future<void>> tasks;
+    size_t n = 0;
+    for (auto bucket:buckets) {
+      BucketHits *r = &results[n++];
+      tasks.emplace_back(SearchPool::instance().submit([&, bucket, r](const std::string &con) {
+        Filestore(con).searchBucket(pool, searchList, bucket, numBuckets, groupId, groupName, stop, nullptr, *r);
+      }));
+    }
+    try {
+      for (auto &t:tasks) {
+        // Fortschritt und Verbindung prüfen, solange die Tasks laufen
+        while (t.wait_for(std::chrono::milliseconds(200)) != std::future_status::ready)
+          ckFun(80 * cnt / maxCnt);
+        if (results[cnt].primaryEmpty) // restliche Buckets sind ohne Belang
+          stop.cancel();
+        cnt++;
+        ckFun(80 * cnt / maxCnt);
       }
-      now = std::chrono::system_clock::now();
-      LOG(LM_INFO, "TIME " << std::chrono::duration_cast<std::chrono::milliseconds>(now - begin).count());
+    } catch (...) {
+      // Tasks verwenden lokale Daten, daher vor dem Verlassen abbrechen und abwarten
+      stop.cancel();
+      for (auto &t:tasks)
+        t.wait();
+      throw;
     }
+    for (auto &t:tasks)
+      t.get();
+    cancel.check();
+  } else {
+    size_t n = 0;
+    std::function<void()> tick = [&ckFun, &cnt, maxCnt]() { ckFun(80 * cnt / maxCnt); };
+    for (auto bucket:buckets) {
+      BucketHits &r = results[n++];
+      searchBucket(pool, searchList, bucket, numBuckets, groupId, groupName, stop, tick, r);
+      cancel.check();
+      if (r.primaryEmpty)
+        break;
+      cnt++;
+      ckFun(80 * cnt / maxCnt);
+    }
+  }
+
+  std::list<uint64_t> docList;
+  DocIdSet docIdsPrim;
+  size_t n = 0;
+  bool primaryEmpty = false;
+  for (auto bucket:buckets) {
+    BucketHits &r = results[n++];
+    if (r.primaryEmpty) {
+      primaryEmpty = true;
+      break;
+    }
+    docIdsPrim.swap(r.matched);
     if (bucket != 0 or buckets.size() == 1)
-      docList.insert(docList.end(), docIds.begin(), docIds.end());
-    cnt++;
+      docList.insert(docList.end(), r.docIds.begin(), r.docIds.end());
   }
 
-  if (docList.empty())
-    return result;
+  if (primaryEmpty or docList.empty()) {
+    if (searchCache.enabled())
+      cacheHits(cacheKey, hits, searchList, cacheGen);
+    return;
+  }
 
   LOG(LM_INFO, "found " << docList.size() << " documents " << docIdsPrim.size() << " primaryId");
+  DocIdSet found(docList.begin(), docList.end());
+  hits.docIds.assign(found.begin(), found.end());
+  if (groupId) // thus primary is sorted first
+    std::stable_partition(hits.docIds.begin(), hits.docIds.end(),
+                          [&docIdsPrim](DocId id) { return docIdsPrim.contains(id); });
+  hits.primIds.swap(docIdsPrim);
+  if (searchCache.enabled())
+    cacheHits(cacheKey, hits, searchList, cacheGen);
   now = std::chrono::system_clock::now();
   LOG(LM_INFO, "TIME " << std::chrono::duration_cast<std::chrono::milliseconds>(now - begin).count());
+}
 
-  Q query2;
-  query2 << Q::AndBegin << ti.active.QiEq(true) << ti.docId.QiIn(docList) << Q::AndEnd;
+void Filestore::cacheHits(const std::string &key, const SearchHits &hits,
+                          const std::map<std::string, TagSearch> &searchList, uint64_t generation) {
+  // alle TagIds, deren neue Inhalte das Ergebnis verändern können
+  std::multimap<TagId, std::string> conditions;
+  std::set<int> buckets = hits.buckets;
+  buckets.insert(0);
+  for (auto bucket:buckets) {
+    for (auto &i:searchList) {
+      TagId id = findTag(hits.pool, i.second.tagName, bucket);
+      if (id > 0)
+        conditions.emplace(id, i.first);
+    }
+  }
+  searchCache.put(key, hits, searchList, conditions, generation);
+}
 
-  std::set<uint64_t> docRead;
-  maxCnt = docList.size();
-  for (auto cursor = dbi.query(ti, query2); not cursor->eof(); cursor->next()) {
-    ckFun(95);
-//    ckFun(20 + 80 * docRead.size() / maxCnt);
-//    usleep(50000);
+void Filestore::setSearchCache(size_t bytes) {
+  searchCache.setLimit(bytes);
+}
 
-    dbi.retrieve(ti, cursor);
-    SearchResult r;
-    r.tagId = ti.tagId();
-    r.tagContent = ti.content();
-    r.docId = ti.docId();
-    result.emplace_back(r);
-    if (groupId and r.tagId == groupId and docIdsPrim.find(r.docId) != docIdsPrim.end()) {
-      r.tagContent.clear();
-      r.tagId = 0;
-      r.docId = ti.docId();
-      result.emplace_front(r);  // thus primary is sorted first
+SearchCacheStats Filestore::searchCacheStats() {
+  return searchCache.stats();
+}
+
+std::list<int> Filestore::hitTagIds(const SearchHits &hits, const std::string &tagName) {
+  std::list<int> tagIds;
+  std::set<int> buckets = hits.buckets;
+  buckets.insert(0);
+  for (auto bucket:buckets) {
+    TagId id = findTag(hits.pool, tagName, bucket);
+    if (id > 0)
+      tagIds.push_back(int(id));
+  }
+  return tagIds;
+}
+
+std::vector<SearchResultDoc> Filestore::loadHits(const SearchHits &hits, const std::vector<DocId> &docIds,
+                                                 const std::set<std::string> &tagNames) {
+  std::chrono::system_clock::time_point begin = std::chrono::system_clock::now();
+  std::vector<SearchResultDoc> result;
+  if (docIds.empty())
+    return result;
+  // Projektion auf die TagIds aller durchsuchten Buckets abbilden
+  std::list<int> tagIds;
+  if (not tagNames.empty()) {
+    for (auto &n:tagNames)
+      tagIds.splice(tagIds.end(), hitTagIds(hits, n));
+    if (hits.groupId)
+      tagIds.push_back(int(hits.groupId));
+  }
+  auto dbi = mobs::DatabaseManager::instance()->getDbIfc(conName);
+  DMGR_Tag ti;
+  using Q = mobs::QueryGenerator;
+
+  // Reihenfolge der Treffer beibehalten, Tags in einem Durchlauf je Dokument gruppieren
+  std::unordered_map<DocId, size_t> docPos;
+  docPos.reserve(docIds.size());
+  result.reserve(docIds.size());
+  for (auto id:docIds) {
+    if (docPos.emplace(id, result.size()).second)
+      result.emplace_back(id);
+  }
+  const size_t maxIn = 1000; // DocIds je Query
+  bool noTags = not tagNames.empty() and tagIds.empty();
+  for (auto it = docIds.begin(); it != docIds.end() and not noTags;) {
+    std::list<uint64_t> docList;
+    for (; it != docIds.end() and docList.size() < maxIn; it++)
+      docList.push_back(*it);
+    Q query2;
+    query2 << Q::AndBegin << ti.active.QiEq(true) << ti.docId.QiIn(docList);
+    if (not tagIds.empty())
+      query2 << ti.tagId.QiIn(tagIds);
+    query2 << Q::AndEnd;
+    for (auto cursor = dbi.query(ti, query2); not cursor->eof(); cursor->next()) {
+      dbi.retrieve(ti, cursor);
+      auto pos = docPos.find(ti.docId());
+      if (pos == docPos.end())
+        continue;
+      SearchResultDoc &doc = result[pos->second];
+      doc.tags.emplace_back(ti.tagId(), ti.content());
+      if (hits.groupId and ti.tagId() == hits.groupId and hits.primIds.contains(doc.docId))
+        doc.primary = true;
     }
-    docRead.insert(r.docId);
   }
-  now = std::chrono::system_clock::now();
-  LOG(LM_INFO, "TIME " << std::chrono::duration_cast<std::chrono::milliseconds>(now - begin).count());
+  std::chrono::system_clock::time_point now = std::chrono::system_clock::now();
+  LOG(LM_INFO, "loaded " << result.size() << " documents TIME "
+                         << std::chrono::duration_cast<std::chrono::milliseconds>(now - begin).count());
   return result;
 }
 
+void Filestore::facetCounts(const SearchHits &hits, const std::string &tagName, std::map<std::string, size_t> &counts) {
+  counts.clear();
+  std::list<int> tagIds = hitTagIds(hits, tagName);
+  if (tagIds.empty() or hits.docIds.empty())
+    return;
+  auto dbi = mobs::DatabaseManager::instance()->getDbIfc(conName);
+  DMGR_Tag ti;
+  using Q = mobs::QueryGenerator;
+  const size_t maxIn = 1000; // DocIds je Query
+  for (auto it = hits.docIds.begin(); it != hits.docIds.end();) {
+    std::list<uint64_t> docList;
+    for (; it != hits.docIds.end() and docList.size() < maxIn; it++)
+      docList.push_back(*it);
+    // jedes Dokument je Inhalt nur einmal zählen
+    std::set<std::pair<DocId, std::string>> seen;
+    Q query;
+    query << Q::AndBegin << ti.active.QiEq(true) << ti.tagId.QiIn(tagIds) << ti.docId.QiIn(docList) << Q::AndEnd;
+    for (auto cursor = dbi.query(ti, query); not cursor->eof(); cursor->next()) {
+      dbi.retrieve(ti, cursor);
+      if (seen.emplace(ti.docId(), ti.content()).second)
+        counts[ti.content()]++;
+    }
+  }
+  LOG(LM_INFO, "facet " << tagName << " " << counts.size() << " values");
+}
+
+void Filestore::orderHits(const SearchHits &hits, const std::string &tagName, bool descending, size_t k,
+                          std::vector<DocId> &result) {
+  std::chrono::system_clock::time_point begin = std::chrono::system_clock::now();
+  result.clear();
+  if (k == 0 or k > hits.docIds.size())
+    k = hits.docIds.size();
+  if (k == 0)
+    return;
+  using Entry = std::pair<std::string, DocId>;
+  // a vor b einordnen
+  auto before = [descending](const Entry &a, const Entry &b) { return descending ? b < a : a < b; };
+  // oben liegt der schlechteste der bisher besten k
+  std::priority_queue<Entry, std::vector<Entry>, decltype(before)> heap(before);
+  std::vector<DocId> missing; // Dokumente ohne den Tag, höchstens k
+  std::list<int> tagIds = hitTagIds(hits, tagName);
+  auto dbi = mobs::DatabaseManager::instance()->getDbIfc(conName);
+  DMGR_Tag ti;
+  using Q = mobs::QueryGenerator;
+  const size_t maxIn = 1000; // DocIds je Query
+  for (auto it = hits.docIds.begin(); it != hits.docIds.end();) {
+    auto chunk = it;
+    std::list<uint64_t> docList;
+    for (; it != hits.docIds.end() and docList.size() < maxIn; it++)
+      docList.push_back(*it);
+    // je Dokument nur der beste Inhalt
+    std::unordered_map<DocId, std::string> keys;
+    if (not tagIds.empty()) {
+      Q query;
+      query << Q::AndBegin << ti.active.QiEq(true) << ti.tagId.QiIn(tagIds) << ti.docId.QiIn(docList) << Q::AndEnd;
+      for (auto cursor = dbi.query(ti, query); not cursor->eof(); cursor->next()) {
+        dbi.retrieve(ti, cursor);
+        auto ins = keys.emplace(ti.docId(), ti.content());
+        if (not ins.second and before(Entry(ti.content(), ti.docId()), Entry(ins.first->second, ti.docId())))
+          ins.first->second = ti.content();
+      }
+    }
+    for (; chunk != it; chunk++) {
+      auto key = keys.find(*chunk);
+      if (key == keys.end()) {
+        if (missing.size() < k)
+          missing.push_back(*chunk);
+        continue;
+      }
+      Entry e(std::move(key->second), *chunk);
+      if (heap.size() < k)
+        heap.push(std::move(e));
+      else if (before(e, heap.top())) {
+        heap.pop();
+        heap.push(std::move(e));
+      }
+    }
+  }
+  result.resize(heap.size());
+  for (size_t i = heap.size(); i > 0; i--) {
+    result[i - 1] = heap.top().second;
+    heap.pop();
+  }
+  for (auto id:missing) {
+    if (result.size() >= k)
+      break;
+    result.push_back(id);
+  }
+  std::chrono::system_clock::time_point now = std::chrono::system_clock::now();
+  LOG(LM_INFO, "order by " << tagName << " top " << result.size() << " of " << hits.docIds.size() << " TIME "
+                           << std::chrono::duration_cast<std::chrono::milliseconds>(now - begin).count());
+}
+
 void
 Filestore::bucketSearch(const std::string &pool, const std::map<int, TagSearch> &searchList, std::set<int> &result) {
   LOG(LM_INFO, "search ");
@@ -831,7 +1924,7 @@ void Filestore::loadBuckets(std::map<std::string, BucketPool> &buckets) {
     else
       e.prio = bp.prio();
     if (e.prio and not bp.regex().empty() and not bp.format().empty())
-      e.formatter.insertPattern(mobs::to_wstring(bp.regex()), mobs::to_wstring(bp.format()));
+      e.formatter.insertPattern(bp.regex(), bp.format());
   }
 }
 
@@ -852,6 +1945,7 @@ void Filestore::loadTemplatesFromFile(const std::string &filename) {
   ConfigResult cr;
   mobs::string2Obj(buf, cr); //, mobs::ConvObjFromStr().useExceptUnknown());
   LOG(LM_INFO, cr.to_string());
+  bool changed = false;
 
   for (auto &t:cr.templates) {
     if (t.type() == TemplateBucket) {
@@ -866,9 +1960,10 @@ void Filestore::loadTemplatesFromFile(const std::string &filename) {
         bp.displayOnly(i.type() == TagDisplay);
         bp.regex(i.regex());
         bp.format(i.format());
-        if (bp.isModified())
+        if (bp.isModified()) {
           dbi.save(bp);
-        else
+          changed = true;
+        } else
           LOG(LM_INFO, "bucket nothing changed");
       }
     } else {
@@ -879,13 +1974,30 @@ void Filestore::loadTemplatesFromFile(const std::string &filename) {
         tp.clearModified();
       }
       tp.carelessCopy(t);
-      if (tp.isModified())
+      if (tp.isModified()) {
         dbi.save(tp);
-      else
+        changed = true;
+      } else
         LOG(LM_INFO, "template nothing changed");
     }
   }
+  if (changed) {
+    // laufende Server laden die Konfiguration bei neuer Version nach
+    DMGR_Counter cntr;
+    cntr.id(DMGR_Counter::CntrConfig);
+    dbi.load(cntr);
+    dbi.save(cntr);
+    LOG(LM_INFO, "config version " << cntr.counter());
+  }
+}
 
+int64_t Filestore::configVersion() {
+  auto dbi = mobs::DatabaseManager::instance()->getDbIfc(conName);
+  DMGR_Counter cntr;
+  cntr.id(DMGR_Counter::CntrConfig);
+  if (not dbi.load(cntr))
+    return 0;
+  return cntr.counter();
 }
 
 void Filestore::addUser(const std::string &fingerprint, const std::string &user, const std::string &pubKey) {
@@ -921,11 +2033,11 @@ int BucketPool::getTokenList(const TagSearch &tagSearch, TagSearch &tagResult) {
   tagResult.tagOpList.clear();
   if (it->second.prio) {
     for (auto &i:tagSearch.tagOpList) {
-      std::wstring result;
+      std::string result;
       if (it->second.formatter.empty())
         tagResult.tagOpList.emplace(i.first, i.second);
-      else if (it->second.formatter.format(mobs::to_wstring(i.first), result))
-        tagResult.tagOpList.emplace(mobs::to_string(result), i.second);
+      else if (it->second.formatter.format(i.first, result))
+        tagResult.tagOpList.emplace(result, i.second);
     }
   }
   return it->second.prio;
@@ -951,12 +2063,11 @@ bool BucketPool::getToken(const std::string &name, const std::string &content,
       if (i.second.prio) {
         if (i.second.prio >= bucketToken.size())
           bucketToken.resize(i.second.prio);
-        std::wstring result;
         std::string var;
         if (i.second.formatter.empty())
           var = content;
-        else if (i.second.formatter.format(mobs::to_wstring(content), result))
-          var = mobs::to_string(result);
+        else
+          i.second.formatter.format(content, var);
         if (prioCheck.find(i.second.prio) == prioCheck.end()) { // already filled
           if (bucketToken[i.second.prio - 1] != var)
             THROW("token mismatch " << bucketToken[i.second.prio - 1] << " <-> " << var);
@@ -26,9 +26,14 @@
 #include <utility>
 #include <mobs/converter.h>
 #include <set>
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
 #include "mobs/dbifc.h"
 #include "mobs/mchrono.h"
 #include "mrpc.h"
+#include "docidset.h"
+#include "tagformat.h"
 
 using DocId = int64_t;
 using TagId = int64_t;
@@ -76,6 +81,7 @@ public:
 //  TagId tagId;
   std::string tagName;
   bool primary = false;
+  /// (Inhalt, Operator); Operator "CONTAINS" ist eine Teilwortsuche über den Trigramm-Index der Such-Tags (name$$)
   std::multimap<std::string, std::string> tagOpList{};
 };
 
@@ -86,12 +92,31 @@ public:
   DocId docId{};
 };
 
+/// Treffer einer Suche ohne Tags; Grundlage für das seitenweise Laden mit Filestore::loadHits
+class SearchHits {
+public:
+  std::vector<DocId> docIds; ///< Dokumente der Primärsuche zuerst, sonst aufsteigend
+  DocIdSet primIds;          ///< Kandidaten der Primärsuche bei Gruppensuche
+  TagId groupId = 0;
+  std::string pool;
+  std::set<int> buckets;     ///< durchsuchte Buckets
+};
+
+/// Treffer eines Dokuments mit allen aktiven Tags in Lesereihenfolge
+class SearchResultDoc {
+public:
+  explicit SearchResultDoc(DocId id = 0) : docId(id) {}
+  DocId docId;
+  bool primary = false; ///< Dokument der Primärsuche bei Gruppensuche
+  std::vector<TagInfo> tags;
+};
+
 class BucketPool {
 public:
   class BucketTag {
   public:
     std::string name;
-    mobs::StringFormatter formatter{};
+    TagFormat formatter{};
     int prio = 0;
     bool displayOnly = false;
   };
@@ -115,6 +140,57 @@ public:
 
 
 
+/// Abbruch einer Anfrage durch CancelToken::check
+class SearchCanceled : public std::runtime_error {
+public:
+  explicit SearchCanceled(bool t) : std::runtime_error(t ? "deadline exceeded" : "canceled"), timeout(t) {}
+  bool timeout; ///< Abbruch wegen Zeitüberschreitung, sonst Verbindung zum Client verloren
+};
+
+/** \brief kooperativer Abbruch einer laufenden Suche
+ *
+ * Wird zwischen den Datensätzen der Cursor abgefragt; ein Token mit parent gilt auch als abgebrochen,
+ * wenn parent abgebrochen ist. cancel() darf aus jedem Thread aufgerufen werden.
+ */
+class CancelToken {
+public:
+  explicit CancelToken(const CancelToken *p = nullptr) : parent(p) {}
+  void cancel() { canceledFlag = true; }
+  /// Abbruch nach Ablauf von timeout, vor Beginn der Suche setzen
+  void setTimeout(std::chrono::milliseconds timeout) {
+    deadline = std::chrono::steady_clock::now() + timeout;
+    hasDeadline = true;
+  }
+  bool timedOut() const {
+    return (hasDeadline and std::chrono::steady_clock::now() >= deadline) or (parent and parent->timedOut());
+  }
+  bool canceled() const { return canceledFlag or timedOut() or (parent and parent->canceled()); }
+  /// wirft SearchCanceled, wenn abgebrochen
+  void check() const {
+    if (canceled())
+      throw SearchCanceled(timedOut());
+  }
+
+private:
+  const CancelToken *parent;
+  std::atomic<bool> canceledFlag{false};
+  bool hasDeadline = false;
+  std::chrono::steady_clock::time_point deadline{};
+};
+
+/// Zähler des Such-Caches
+class SearchCacheStats {
+public:
+  size_t hits = 0;
+  size_t misses = 0;
+  size_t invalidations = 0; ///< durch neue Dokumente verworfene Einträge
+  size_t evictions = 0;     ///< wegen des Speicherbudgets verdrängte Einträge
+  size_t entries = 0;
+  size_t memory = 0;
+};
+
+class BucketHits;
+
 /** \brief Ablage der Files im Filesystem, SQLite DB
  *
  */
@@ -123,6 +199,10 @@ public:
   explicit Filestore();
   explicit Filestore(std::string con);
   static void newDbInstance(const std::string &con);
+  /// In-Memory-Index der aktiven Tags aufbauen und für die Suche aktivieren
+  void buildTagIndex();
+  /// Trigramm-Index der Such-Tags aus den aktiven Tags neu aufbauen
+  void rebuildTrigramIndex();
 
   std::string writeFile(std::istream &source, const DocInfo &info);
   void readFile(const std::string &file, std::ostream &dest);
@@ -145,9 +225,30 @@ public:
   void bucketSearch(const std::string &pool, const std::map<int, TagSearch> &searchList, std::set<int> &result);
 
   //  void tagSearch(const std::list<TagSearchInfo> &searchList, std::list<SearchResult> &result);
-  /// alle Bedingungen oder-verknüpfen
-  std::list<SearchResult> searchTags(const std::string &pool, const std::map<std::string, TagSearch> &searchList,
-                                     const std::set<int> &buckets, const std::string &groupName, std::function<void (int)> ckFun);
+  /** \brief alle Bedingungen und-verknüpfen
+   *
+   * Ermittelt nur die DocIds der Treffer, die Tags werden mit loadHits seitenweise geladen
+   */
+  void searchHits(const std::string &pool, const std::map<std::string, TagSearch> &searchList,
+                  const std::set<int> &buckets, const std::string &groupName, std::function<void (int)> ckFun,
+                  const CancelToken &cancel, SearchHits &hits);
+  /** \brief Tags einer Seite von Treffern laden
+   *
+   * @param docIds Seite aus hits.docIds bzw. aus orderHits
+   * @param tagNames nur diese Tags laden, leer = alle; der Gruppen-Tag wird immer geladen
+   * @return Treffer je Dokument gruppiert in der Reihenfolge von docIds
+   */
+  std::vector<SearchResultDoc> loadHits(const SearchHits &hits, const std::vector<DocId> &docIds,
+                                        const std::set<std::string> &tagNames = {});
+  /** \brief die ersten k Treffer nach dem Inhalt des Tags tagName ordnen
+   *
+   * Verwendet einen auf k begrenzten Heap; Dokumente ohne den Tag folgen am Ende in der Reihenfolge von hits.docIds
+   * @param k Anzahl, 0 = alle
+   */
+  void orderHits(const SearchHits &hits, const std::string &tagName, bool descending, size_t k,
+                 std::vector<DocId> &result);
+  /// Anzahl Treffer je Inhalt des Tags tagName, ohne die übrigen Tags zu laden
+  void facetCounts(const SearchHits &hits, const std::string &tagName, std::map<std::string, size_t> &counts);
   /// tag info zu einem Dokument
   void getTagInfo(DocId id, std::list<SearchResult> &result, DocInfo &doc);
   /// document indo
@@ -160,6 +261,8 @@ public:
   void loadBuckets(std::map<std::string, BucketPool> &buckets);
 
   void loadTemplatesFromFile(const std::string &filename);
+  /// wird bei jeder Änderung durch loadTemplatesFromFile erhöht
+  int64_t configVersion();
 
   static void setBase(const std::string &basedir, bool genKey = false);
 
@@ -170,7 +273,22 @@ public:
   static const std::string &privateKey() { return  priv; };
   static const std::string &publicKey() { return  pub; };
 
+  /// Anzahl Threads für die parallele Auswertung von Buckets, 0 = im aufrufenden Thread
+  static void setSearchThreads(size_t threads);
+  /// Speicherbudget des Such-Caches in Bytes, 0 = aus
+  static void setSearchCache(size_t bytes);
+  static SearchCacheStats searchCacheStats();
 private:
+  /// Suche in einem Bucket, läuft ggf. in einem Thread des Such-Pools mit eigener Verbindung
+  void searchBucket(const std::string &pool, const std::map<std::string, TagSearch> &searchList, int bucket,
+                    size_t numBuckets, TagId groupId, const std::string &groupName, const CancelToken &cancel,
+                    const std::function<void()> &tick, BucketHits &result);
+  /// Ergebnis mit den TagIds seiner Bedingungen im Such-Cache ablegen
+  void cacheHits(const std::string &key, const SearchHits &hits, const std::map<std::string, TagSearch> &searchList,
+                 uint64_t generation);
+  /// TagIds des Tags tagName in allen durchsuchten Buckets
+  std::list<int> hitTagIds(const SearchHits &hits, const std::string &tagName);
+
   std::string conName;
   static std::string base;
   static std::string pub;
@@ -24,6 +24,7 @@
 #include "mobs/mchrono.h"
 #include <vector>
 #include <string>
+#include <utility>
 
 #define VISITOR(Class) void visit(mobs::ObjVisitor &visitor) override { auto v = dynamic_cast<Class *>(&visitor); if (v) v->visit(*this); }
 
@@ -36,9 +37,12 @@ class GetConfig;
 class Ping;
 class GetPub;
 class Dump;
+class SearchHits;
 class ExecVisitor : virtual public mobs::ObjVisitor {
 public:
-  ExecVisitor(mobs::XmlOut &xmlOut, XmlInput &xi) : m_xmlOut(xmlOut), m_xi(xi) {}
+  /// reqId > 0: Anfrage läuft parallel zu weiteren der Verbindung, jede Antwort wird ein eigener Block
+  ExecVisitor(mobs::XmlOut &xmlOut, XmlInput &xi, std::string conName, int64_t reqId = 0) :
+          m_xmlOut(xmlOut), m_xi(xi), m_conName(std::move(conName)), m_reqId(reqId) {}
   void visit(mobs::ObjectBase &obj) override;
   void visit(GetDocument &obj);
   void visit(SearchDocument &obj);
@@ -47,8 +51,21 @@ public:
   void visit(Ping &obj);
   void visit(GetPub &obj);
   void visit(Dump &obj);
+  /// Suche ausführen, liefert nur die DocIds
+  void search(SearchDocument &obj, SearchHits &hits);
+  /// Antwort mit der reqId der Anfrage senden; flush beendet den Block
+  template<class T>
+  void send(T &obj, bool flush = false) {
+    if (m_reqId)
+      obj.reqId(m_reqId);
+    write(obj, flush or m_reqId > 0);
+  }
+  /// Objekt unter dem Schreib-Mutex der Verbindung in den verschlüsselten Block schreiben
+  void write(mobs::ObjectBase &obj, bool flush);
   mobs::XmlOut &m_xmlOut;
   XmlInput &m_xi;
+  std::string m_conName; // DB-Verbindung des ausführenden Workers
+  int64_t m_reqId;
 };
 #endif
 
@@ -58,13 +75,14 @@ public:
   ObjInit(Session);
 
   MemVar(u_int, id);
+  MemVar(std::vector<u_char>, ticket, USENULL); // aus SessionResult; stellt eine verfallene Session ohne RSA wieder her
 
 };
 ObjRegister(Session);
 
 
-MOBS_ENUM_DEF(SessionErrorIds, SErrUnknown, SErrNeedCredentioal, SErrInvalidCert, SErrNoMoreCon, SErrAccessDenied);
-MOBS_ENUM_VAL(SessionErrorIds, "UNK",       "NEED_CREDENTIAL",   "NOC_ERT",       "NO_CON",      "NO_ACC");
+MOBS_ENUM_DEF(SessionErrorIds, SErrUnknown, SErrNeedCredentioal, SErrInvalidCert, SErrNoMoreCon, SErrAccessDenied, SErrTimeout);
+MOBS_ENUM_VAL(SessionErrorIds, "UNK",       "NEED_CREDENTIAL",   "NOC_ERT",       "NO_CON",      "NO_ACC",         "TIMEOUT");
 
 class SessionError : virtual public mobs::ObjectBase
 {
@@ -73,6 +91,7 @@ public:
 
   MemMobsEnumVar(SessionErrorIds, error);
   MemVar(std::string, msg);
+  MemVar(int64_t, reqId, USENULL); // Anfrage, die den Fehler ausgelöst hat
 
 };
 
@@ -114,6 +133,7 @@ public:
   MemVar(std::vector<u_char>, key);
   MemVar(u_int, id);
   MemVar(std::string, info);
+  MemVar(std::vector<u_char>, ticket, USENULL); // nur für den Server lesbar, bei Session mitsenden
 };
 
 class PublicKey : virtual public mobs::ObjectBase
@@ -158,6 +178,7 @@ public:
 
   MemVar(int, percent);
   MemVar(std::string, comment);
+  MemVar(int64_t, reqId, USENULL);
 };
 
 
@@ -184,11 +205,32 @@ public:
   MemVar(mobs::MTime, creationTime, USENULL); /// Zeitpunkt der Erzeugung, wenn ungleich Eintragezeitpunkt
 };
 
+class FacetValue : virtual public mobs::ObjectBase {
+public:
+  ObjInit(FacetValue);
+
+  MemVar(std::string, content);
+  MemVar(int64_t, count);
+};
+
+/// Verteilung der Inhalte eines Tags über alle Treffer
+class Facet : virtual public mobs::ObjectBase {
+public:
+  ObjInit(Facet);
+
+  MemVar(std::string, name);
+  MemVector(FacetValue, values);
+};
+
 class SearchDocumentResult : virtual public mobs::ObjectBase {
 public:
   ObjInit(SearchDocumentResult);
 
   MemVector(DocumentInfo, tags); // ohne creation-Infos
+  MemVar(int64_t, total, USENULL);      // Anzahl aller Treffer
+  MemVar(std::string, cursor, USENULL); // Fortsetzung für die nächste Seite, leer wenn vollständig
+  MemVector(Facet, facets, USEVECNULL); // angeforderte Facetten
+  MemVar(int64_t, reqId, USENULL);      // Kennung der Anfrage
 
 };
 
@@ -199,6 +241,15 @@ public:
   MemVar(std::string, pool);
   MemVar(std::string, templateName); // für fixedTags und Berechtigung; ist TemplateName gesetzt, wird pool ignoriert
   MemVector(DocumentTags, tags);
+  MemVar(int, limit, USENULL);          // maximale Anzahl Dokumente je Antwort, 0 = alle
+  MemVar(int, offset, USENULL);         // erstes Dokument der Antwort
+  MemVar(std::string, cursor, USENULL); // Fortsetzung einer vorherigen Suche; tags werden dann ignoriert
+  MemVar(bool, countOnly, USENULL);     // nur Anzahl und Facetten liefern, keine Dokumente
+  MemVarVector(std::string, facets);    // Tags, deren Inhalte über alle Treffer gezählt werden
+  MemVarVector(std::string, returnTags); // zu liefernde Tags; leer = Anzeige-Tags des Templates, "*" = alle
+  MemVar(std::string, orderBy, USENULL); // Treffer nach dem Inhalt dieses Tags ordnen, z.B. $creation
+  MemVar(bool, descending, USENULL);     // absteigend ordnen
+  MemVar(int64_t, reqId, USENULL);       // gesetzt: parallel ausführen, Antworten tragen dieselbe reqId
 
 #ifdef MRPC_SERVER
   void visit(mobs::ObjVisitor &visitor) override { auto v = dynamic_cast<ExecVisitor *>(&visitor); if (v) v->visit(*this); };
@@ -216,6 +267,7 @@ public:
   MemVar(std::string, type);  // TODO sinvoll? evtl. Typ-Konvertierung oder einzelne Seiten
   MemVar(bool, allowAttach);  // große Dokumente dürfen als Attachment gesendet werden
   MemVar(bool, allInfos);     // alle vorhandenen Infos senden
+  MemVar(int64_t, reqId, USENULL); // gesetzt: parallel ausführen, Antworten tragen dieselbe reqId
 #ifdef MRPC_SERVER
   VISITOR(ExecVisitor);
 #endif
@@ -243,6 +295,7 @@ public:
   MemVar(std::string, name);
   MemVar(std::string, pool, USENULL);
   MemVar(std::vector<u_char>, content);
+  MemVar(int64_t, reqId, USENULL);
 
 };
 
@@ -258,6 +311,7 @@ public:
   MemVar(std::string, name);
   MemVar(std::string, pool, USENULL);
   MemVar(int64_t, size);
+  MemVar(int64_t, reqId, USENULL);
 };
 
 
@@ -328,6 +382,7 @@ class GetConfig : virtual public mobs::ObjectBase {
 public:
   ObjInit(GetConfig);
   MemVar(bool, start);
+  MemVar(int64_t, reqId, USENULL); // gesetzt: parallel ausführen, Antworten tragen dieselbe reqId
 #ifdef MRPC_SERVER
   VISITOR(ExecVisitor);
 #endif
@@ -337,6 +392,7 @@ class ConfigResult : virtual public mobs::ObjectBase {
 public:
   ObjInit(ConfigResult);
   MemVector(TemplateInfo, templates);
+  MemVar(int64_t, reqId, USENULL);
 
 };
 
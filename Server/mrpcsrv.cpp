@@ -27,20 +27,40 @@
 #include "mobs/rsa.h"
 #include "mobs/tcpstream.h"
 #include "mobs/converter.h"
+#include <openssl/hmac.h>
+#include <openssl/evp.h>
+#include <openssl/crypto.h>
 
 #define MRPC_SERVER
 #include "mrpc.h"
 
 #include "filestore.h"
+#include "tagformat.h"
 #include <fstream>
+#include <sstream>
+#include <iterator>
 #include <array>
 #include <set>
 #include <thread>
 #include <mutex>
 #include <condition_variable>
+#include <atomic>
+#include <algorithm>
 #include <utility>
+#include <tuple>
 #include <sys/stat.h>
 #include <getopt.h>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <csignal>
+#include <memory>
+#include <cerrno>
+#include <sys/socket.h>
+#include <poll.h>
+#ifdef __linux__
+#include <sys/epoll.h>
+#endif
 
 ObjRegister(SessionError);
 ObjRegister(CommandResult);
@@ -53,6 +73,8 @@ using namespace std;
 
 class SessionContext;
 class XmlInput;
+class Connection;
+class ConfigSnapshot;
 
 class MrpcException : public std::runtime_error {
 public:
@@ -69,18 +91,94 @@ public:
 class MRpcServer {
 public:
   std::string service = "4444";
+  int minWorker = 3; ///< Anzahl ständig laufender Worker-Threads
+  int maxWorker = 3; ///< maximale Anzahl Worker-Threads
 
   void server();
 
+  int sessionTimeout = 3600; ///< Sekunden, nach denen eine unbenutzte Session verfällt
+  size_t sessionMemLimit = 256 * 1024 * 1024; ///< Speicherbudget aller Sessions in Bytes
+  int searchTimeout = 120; ///< Sekunden, nach denen eine Suche abgebrochen wird, 0 = unbegrenzt
+  int ticketLifetime = 86400; ///< Sekunden, die ein Session-Ticket gültig ist
+
   SessionContext *getSession(u_int id);
   SessionContext *newSession(u_int &id, const std::string &login);
+  void releaseSession(SessionContext *ctx);
+  /// Ticket mit Session-Key und Benutzer erzeugen, verschlüsselt mit dem Ticket-Key des Servers
+  std::vector<u_char> issueTicket(const SessionContext &ctx);
+  /// verfallene oder verdrängte Session aus einem Ticket wiederherstellen; nullptr, wenn das Ticket ungültig ist
+  SessionContext *resumeSession(u_int id, const std::vector<u_char> &ticket);
+
+  /// aktueller Stand der Konfiguration
+  std::shared_ptr<const ConfigSnapshot> config() const { return std::atomic_load(&configSnapshot); }
+  /// Konfiguration neu laden, wenn sich die Version in der DB geändert hat oder force gesetzt ist
+  void reloadConfig(bool force);
+  /// Signal-Handler: Konfiguration neu laden
+  static void requestReload(int);
 
 protected:
+  friend class Connection;
+  friend class XmlInput;
   static void worker_thread(int id, MRpcServer *);
+  static void reactor_thread(MRpcServer *);
+  static void housekeeping_thread(MRpcServer *);
+  /// abgelaufene Sessions entfernen und bei Überschreiten des Speicherbudgets die ältesten verdrängen
+  void expireSessions();
+  /// neuen Worker starten; innerhalb mutex mw
+  void startWorker();
+  /// Auftrag für einen Worker
+  class Job {
+  public:
+    Connection *conn = nullptr;
+    mobs::ObjectBase *request = nullptr; // parallel auszuführende Anfrage, nullptr = Eingabe der Verbindung lesen
+  };
+  /// nächsten Auftrag abholen; return false, wenn sich der Worker beenden soll
+  bool nextJob(int id, Job &job);
+  /// Worker ist wieder frei
+  void workerIdle();
+  /// Verbindung mit anliegenden Daten einem Worker übergeben
+  void dispatch(Connection *c);
+  /// Anfrage mit reqId parallel auf dem Worker-Pool ausführen; übernimmt obj
+  void dispatchRequest(Connection *c, mobs::ObjectBase *obj);
+  /// Auftrag einreihen; innerhalb mutex mw
+  void enqueue(const Job &job);
+  /// ruhende Verbindung im Reactor auf Daten warten lassen
+  void park(Connection *c);
   mobs::TcpAccept tcpAccept;
-  map<u_int, SessionContext> sessions;
-  u_int sessCntr = 0;
-  mutex m;
+
+  // Sessions, nach Id auf Shards mit eigenem mutex verteilt
+  class SessionShard {
+  public:
+    mutex m;
+    map<u_int, SessionContext> sessions;
+  };
+  static const int sessionShardCnt = 16;
+  SessionShard &sessionShard(u_int id) { return sessionShards[id % sessionShardCnt]; }
+  array<SessionShard, sessionShardCnt> sessionShards;
+  atomic<u_int> sessCntr{0};
+  atomic<size_t> sessionsLive{0};
+  atomic<size_t> sessionsExpired{0};
+  atomic<size_t> sessionsEvicted{0};
+  atomic<size_t> sessionsResumed{0};
+  std::vector<u_char> ticketKey; // zufällig je Serverstart; ein Neustart macht alle Tickets ungültig
+  std::vector<u_char> ticketMacKey; // eigener Schlüssel für die HMAC über IV und Chiffrat
+
+  std::shared_ptr<const ConfigSnapshot> configSnapshot; // nur über atomic_load/atomic_store
+  static std::atomic<bool> reloadRequested;
+
+  // Worker-Pool
+  mutex mw;
+  condition_variable cvWorker;
+  deque<Job> readyJobs;
+  int numWorker = 0;      // laufende Worker
+  int idleWorker = 0;     // Worker ohne Verbindung
+  int workerIdCntr = 0;
+  set<int> freeWorkerIds; // Ids beendeter Worker, deren DB-Verbindung wiederverwendet wird
+
+  // Reactor
+  mutex mr;
+  int epollFd = -1;
+  map<int, Connection *> parkedConnections;
 
 };
 
@@ -94,13 +192,47 @@ public:
   bool doSearch = false; // create extra search tags
   bool infoOnly = false; // no bucket no search
   set<string> token;
-  mobs::StringFormatter formatter{};
+  TagFormat formatter{};
 
   void addInfo(const TemplateTagInfo &t);
   bool format(string &value) const;
 
 };
 
+/// vorbereitete, unveränderliche Tabellen eines Templates; Formatter werden nur einmal kompiliert
+class TemplateCache {
+public:
+  string pool;
+  map<string, TagInfoCache> tagInfo;
+  set<string> displayTags; // Anzeige-Tags; Standard-Projektion der Suche
+  string groupName;        // erster Ident-Tag
+
+  void compile(const TemplateInfo &t);
+  /// Info zum Tag oder nullptr
+  const TagInfoCache *find(const string &tag) const;
+};
+
+/// unveränderlicher Stand von Templates und Buckets, gemeinsam für alle Sessions
+class ConfigSnapshot {
+public:
+  int64_t version = 0;
+  list<TemplateInfo> templates;
+  map<string, TemplateCache> templateCache; // je Template-Name
+  map<string, BucketPool> buckets;
+};
+
+/// serverseitiger Cursor der letzten seitenweise abgerufenen Suche
+class SearchCursor {
+public:
+  string token; // leer, wenn keine Fortsetzung möglich
+  u_int cntr = 0;
+  SearchHits hits;
+  size_t pos = 0; // nächstes auszuliefernde Dokument
+  set<string> returnTags; // Projektion, leer = alle Tags
+  string orderBy; // Sortier-Tag, leer = Reihenfolge der Suche
+  bool descending = false;
+};
+
 class SessionContext {
 public:
   SessionContext(u_int id, std::string  l, std::vector<u_char>  k) : sessionId(id), login(std::move(l)), key(std::move(k)) {}
@@ -109,30 +241,40 @@ public:
   string user;  // username
   vector<u_char> key;
 
-  list<TemplateInfo> tInfo{}; // Liste für diese Session erlaubter Templates
+  std::shared_ptr<const ConfigSnapshot> config; // Templates und Buckets dieser Session
   // TODO System-User ohne Templates für Backup/Restore
-  // Caches für das Template cacheTemplate
-  map<string, TagInfoCache> tagInfoCache;
-  // Caches, für die Buckets
-  map<string, BucketPool> bucketCache;
+  // aktuelles Template aus config, nullptr wenn keines gesetzt
+  const TemplateCache *tmpl = nullptr;
   // Liste der Ids zur letzten Suche, damit nicht wahllos Ids abgerufen werden können
   set<DocId> accessibleIds;
-  string poolCache;
-  string cacheTemplate;
-  string cacheGroupName;
+  SearchCursor searchCursor;
+  // parallele Anfragen: stateMutex schützt config, tmpl und searchCursor, accessMutex die accessibleIds
+  std::mutex stateMutex;
+  std::mutex accessMutex;
+
+  int refCnt = 0; // Anzahl Verbindungen, die die Session benutzen
+  std::chrono::steady_clock::time_point lastUse = std::chrono::steady_clock::now();
 
   void enter();
   void release();
+  /// grob geschätzter Speicherbedarf der Session
+  size_t memUsage() const;
+  /// neuen Stand der Konfiguration übernehmen, Template-Caches verwerfen
+  void useConfig(std::shared_ptr<const ConfigSnapshot> c);
   /// return poolname
   string setTemplate(const string &templateName);
+  /// Info zu einem Tag des aktuellen Templates oder nullptr
+  const TagInfoCache *tagInfo(const string &name) const { return tmpl ? tmpl->find(name) : nullptr; }
+  string groupName() const { return tmpl ? tmpl->groupName : ""; }
 };
 
 
 
 SessionContext *MRpcServer::getSession(u_int id) {
-  std::lock_guard<std::mutex> lock(m);
-  auto it = sessions.find(id);
-  if (it != sessions.end()) {
+  auto &shard = sessionShard(id);
+  std::lock_guard<std::mutex> lock(shard.m);
+  auto it = shard.sessions.find(id);
+  if (it != shard.sessions.end()) {
     it->second.enter();
     return &it->second;
   }
@@ -145,57 +287,455 @@ SessionContext *MRpcServer::newSession(u_int &id, const std::string &login) {
   k.resize(mobs::CryptBufAes::key_size());
   mobs::CryptBufAes::getRand(k);
 
-  std::lock_guard<std::mutex> lock(m);
   id = ++sessCntr;
-  auto it = sessions.insert(map<u_int, SessionContext>::value_type(id, SessionContext(id, login, k))).first;
-  if (it != sessions.end()) {
+  auto &shard = sessionShard(id);
+  std::lock_guard<std::mutex> lock(shard.m);
+  auto it = shard.sessions.emplace(std::piecewise_construct, std::forward_as_tuple(id),
+                                   std::forward_as_tuple(id, login, k)).first;
+  if (it != shard.sessions.end()) {
     LOG(LM_INFO, "CREATE " << id);
+    sessionsLive++;
     it->second.enter();
     return &it->second;
   }
   return nullptr;
 }
 
+/// Inhalt eines Session-Tickets
+class SessionTicket : virtual public mobs::ObjectBase {
+public:
+  ObjInit(SessionTicket);
+
+  MemVar(u_int, id);
+  MemVar(std::string, login);
+  MemVar(std::string, user);
+  MemVar(std::vector<u_char>, key);
+  MemVar(mobs::MTime, expires);
+};
+
+std::vector<u_char> MRpcServer::issueTicket(const SessionContext &ctx) {
+  SessionTicket t;
+  t.id(ctx.sessionId);
+  t.login(ctx.login);
+  t.user(ctx.user);
+  t.key(ctx.key);
+  t.expires(std::chrono::time_point_cast<std::chrono::microseconds>(
+          std::chrono::system_clock::now() + std::chrono::seconds(ticketLifetime)));
+  string plain = t.to_string(mobs::ConvObjToString().exportJson().noIndent());
+
+  vector<u_char> iv;
+  iv.resize(mobs::CryptBufAes::iv_size());
+  mobs::CryptBufAes::getRand(iv);
+  stringstream cipher;
+  mobs::CryptBufAes cry(ticketKey, iv, "", true);
+  cry.setOstr(cipher);
+  ostream ostb(&cry);
+  ostb << plain;
+  ostb.flush();
+  cry.finalize();
+  string c = cipher.str();
+  vector<u_char> result(c.begin(), c.end());
+  // Encrypt-then-MAC: HMAC-SHA256 über das Chiffrat einschließlich IV anhängen
+  u_char mac[EVP_MAX_MD_SIZE];
+  u_int macLen = 0;
+  if (not HMAC(EVP_sha256(), &ticketMacKey[0], int(ticketMacKey.size()), &result[0], result.size(), mac, &macLen))
+    THROW("HMAC failed");
+  result.insert(result.end(), mac, mac + macLen);
+  return result;
+}
+
+SessionContext *MRpcServer::resumeSession(u_int id, const std::vector<u_char> &ticket) {
+  // Entschlüsseln außerhalb mutex
+  SessionTicket t;
+  // HMAC vor dem Entschlüsseln in konstanter Zeit prüfen
+  const size_t macSize = size_t(EVP_MD_size(EVP_sha256()));
+  if (ticket.size() <= macSize) {
+    LOG(LM_ERROR, "invalid ticket for " << id << ": too short");
+    return nullptr;
+  }
+  size_t cipherSize = ticket.size() - macSize;
+  u_char mac[EVP_MAX_MD_SIZE];
+  u_int macLen = 0;
+  if (not HMAC(EVP_sha256(), &ticketMacKey[0], int(ticketMacKey.size()), &ticket[0], cipherSize, mac, &macLen) or
+      macLen != macSize or CRYPTO_memcmp(mac, &ticket[cipherSize], macSize) != 0) {
+    LOG(LM_ERROR, "invalid ticket for " << id << ": HMAC mismatch");
+    return nullptr;
+  }
+  try {
+    vector<u_char> iv;
+    iv.resize(mobs::CryptBufAes::iv_size());
+    stringstream cipher(string(ticket.begin(), ticket.begin() + cipherSize));
+    mobs::CryptBufAes cry(ticketKey, iv, "", true);
+    cry.setIstr(cipher);
+    istream istb(&cry);
+    string plain((istreambuf_iterator<char>(istb)), istreambuf_iterator<char>());
+    if (cry.bad())
+      THROW("decryption failed");
+    mobs::string2Obj(plain, t, mobs::ConvObjFromStr());
+  } catch (exception &e) {
+    LOG(LM_ERROR, "invalid ticket for " << id << ": " << e.what());
+    return nullptr;
+  }
+  if (t.id() != id or t.login().empty() or t.key().size() != mobs::CryptBufAes::key_size()) {
+    LOG(LM_ERROR, "ticket mismatch for " << id);
+    return nullptr;
+  }
+  if (t.expires() < std::chrono::system_clock::now()) {
+    LOG(LM_INFO, "ticket expired " << id);
+    return nullptr;
+  }
+  auto &shard = sessionShard(id);
+  std::lock_guard<std::mutex> lock(shard.m);
+  auto it = shard.sessions.find(id);
+  if (it == shard.sessions.end()) {
+    // Ids stammen aus sessCntr dieses Serverlaufs und kollidieren nicht mit neuen Sessions
+    it = shard.sessions.emplace(std::piecewise_construct, std::forward_as_tuple(id),
+                                std::forward_as_tuple(id, t.login(), t.key())).first;
+    it->second.user = t.user();
+    LOG(LM_INFO, "RESUME " << id);
+    sessionsLive++;
+    sessionsResumed++;
+  }
+  it->second.enter();
+  return &it->second;
+}
+
+void MRpcServer::releaseSession(SessionContext *ctx) {
+  auto &shard = sessionShard(ctx->sessionId);
+  std::lock_guard<std::mutex> lock(shard.m);
+  ctx->release();
+}
+
+void MRpcServer::expireSessions() {
+  auto now = std::chrono::steady_clock::now();
+  size_t memTotal = 0;
+  // unbenutzte Sessions mit letztem Zugriff für LRU
+  vector<pair<std::chrono::steady_clock::time_point, u_int>> lru;
+  for (auto &shard:sessionShards) {
+    std::lock_guard<std::mutex> lock(shard.m);
+    for (auto it = shard.sessions.begin(); it != shard.sessions.end();) {
+      if (it->second.refCnt <= 0 and
+          std::chrono::duration_cast<std::chrono::seconds>(now - it->second.lastUse).count() > sessionTimeout) {
+        LOG(LM_INFO, "EXPIRE " << it->first);
+        it = shard.sessions.erase(it);
+        sessionsLive--;
+        sessionsExpired++;
+        continue;
+      }
+      memTotal += it->second.memUsage();
+      if (it->second.refCnt <= 0)
+        lru.emplace_back(it->second.lastUse, it->first);
+      it++;
+    }
+  }
+  if (memTotal > sessionMemLimit) {
+    std::sort(lru.begin(), lru.end());
+    for (auto &i:lru) {
+      if (memTotal <= sessionMemLimit)
+        break;
+      auto &shard = sessionShard(i.second);
+      std::lock_guard<std::mutex> lock(shard.m);
+      auto it = shard.sessions.find(i.second);
+      // Session könnte inzwischen wieder benutzt werden
+      if (it == shard.sessions.end() or it->second.refCnt > 0)
+        continue;
+      size_t sz = it->second.memUsage();
+      memTotal -= std::min(sz, memTotal);
+      LOG(LM_INFO, "EVICT " << i.second << " " << sz);
+      shard.sessions.erase(it);
+      sessionsLive--;
+      sessionsEvicted++;
+    }
+  }
+  LOG(LM_INFO, "SESSIONS live=" << sessionsLive << " expired=" << sessionsExpired << " evicted=" << sessionsEvicted
+                                << " resumed=" << sessionsResumed << " mem=" << memTotal);
+}
+
+void MRpcServer::housekeeping_thread(MRpcServer *server) {
+  for (int tick = 1;; tick++) {
+    std::this_thread::sleep_for(std::chrono::seconds(1));
+    try {
+      if (reloadRequested.exchange(false))
+        server->reloadConfig(true);
+      else if (tick % 60 == 0)
+        server->reloadConfig(false);
+      if (tick % 60 == 0) {
+        server->expireSessions();
+        SearchCacheStats st = Filestore::searchCacheStats();
+        if (st.hits or st.misses)
+          LOG(LM_INFO, "SEARCHCACHE hits=" << st.hits << " misses=" << st.misses << " invalidated="
+                                           << st.invalidations << " evicted=" << st.evictions << " entries="
+                                           << st.entries << " mem=" << st.memory);
+      }
+    } catch (exception &e) {
+      LOG(LM_ERROR, "Housekeeping Exception " << e.what());
+    }
+  }
+}
+
+std::atomic<bool> MRpcServer::reloadRequested{false};
+
+void MRpcServer::requestReload(int) {
+  reloadRequested = true;
+}
+
+void MRpcServer::reloadConfig(bool force) {
+  // eigene Verbindung, "docsrv" gehört Worker 0
+  Filestore store("docsrvhk");
+  int64_t version = store.configVersion();
+  auto current = config();
+  if (current and current->version == version and not force)
+    return;
+  auto c = std::make_shared<ConfigSnapshot>();
+  c->version = version;
+  store.loadTemplates(c->templates);
+  for (auto &t:c->templates)
+    c->templateCache[t.name()].compile(t);
+  store.loadBuckets(c->buckets);
+  std::atomic_store(&configSnapshot, std::shared_ptr<const ConfigSnapshot>(std::move(c)));
+  LOG(LM_INFO, "CONFIG version " << version << " loaded");
+}
+
 // innerhalb mutex
 void SessionContext::enter() {
   LOG(LM_INFO, "ENTER " << sessionId);
+  refCnt++;
+  lastUse = std::chrono::steady_clock::now();
 }
 
+// innerhalb mutex
 void SessionContext::release() {
   LOG(LM_INFO, "RELEASE " << sessionId);
+  refCnt--;
+  lastUse = std::chrono::steady_clock::now();
+}
+
+size_t SessionContext::memUsage() const {
+  size_t sz = sizeof(SessionContext) + key.size() + login.length() + user.length();
+  // Ids liegen als Knoten im set
+  sz += accessibleIds.size() * (sizeof(DocId) + 4 * sizeof(void *));
+  sz += (searchCursor.hits.docIds.size() + searchCursor.hits.primIds.size()) * sizeof(DocId);
+  return sz;
+}
+
+void SessionContext::useConfig(std::shared_ptr<const ConfigSnapshot> c) {
+  if (config == c)
+    return;
+  config = std::move(c);
+  tmpl = nullptr;
 }
 
 string SessionContext::setTemplate(const string &templateName) {
   if ( templateName.empty())
     return "";
-  for (auto const &i:tInfo) {
-    if (i.name() == templateName) {
-      if (cacheTemplate != templateName) {
-        for (auto const &i:tInfo) {
-          if (i.name() == templateName) {
-            poolCache = i.pool();
-            tagInfoCache.clear();
-            for (auto &t:i.tags) {
-              tagInfoCache[t.name()].addInfo(t);
-              if (t.type() == TagIdent and cacheGroupName.empty())  // TODO Schalter in Config oder eigener Type
-                cacheGroupName = t.name();
-            }
-          }
-        }
+  auto it = config->templateCache.find(templateName);
+  tmpl = it == config->templateCache.end() ? nullptr : &it->second;
+  return tmpl ? tmpl->pool : "";
+}
+
+void TemplateCache::compile(const TemplateInfo &t) {
+  pool = t.pool();
+  for (auto &i:t.tags) {
+    tagInfo[i.name()].addInfo(i);
+    if (not i.hide() and not i.maskText().empty())
+      displayTags.insert(i.name());
+    if (i.type() == TagIdent and groupName.empty())  // TODO Schalter in Config oder eigener Type
+      groupName = i.name();
+  }
+}
+
+const TagInfoCache *TemplateCache::find(const string &tag) const {
+  auto it = tagInfo.find(tag);
+  return it == tagInfo.end() ? nullptr : &it->second;
+}
+
+
+/** \brief Eingabepuffer einer Verbindung direkt auf dem Socket
+ *
+ * Der Reactor liest mit receive() ohne zu blockieren, was anliegt; der Parser liest über underflow() und
+ * blockiert erst, wenn der Puffer leer ist. Jedes empfangene Byte wird genau einmal auf Blockgrenzen untersucht:
+ * ein Block ist vollständig, wenn ein Element auf oberster Ebene unterhalb von methodCall geschlossen oder der
+ * Trenner '\0' vor einem Attachment gelesen wurde. Die Binärdaten danach werden nicht untersucht, bis
+ * resumeScan() aufgerufen wird.
+ */
+class SocketInBuf : public std::streambuf {
+public:
+  explicit SocketInBuf(int s) : fd(s) {}
+
+  /// ohne zu blockieren lesen, was anliegt; return false bei Verbindungsende oder Fehler
+  bool receive();
+  /// ungelesene Daten enthalten einen vollständigen Block
+  bool complete() const { return completeAt > readPos(); }
+  /// Anzahl gepufferter, noch nicht gelesener Bytes
+  size_t unread() const { return size_t(egptr() - gptr()); }
+  /// Verbindung beendet oder Lesefehler
+  bool closed() const { return eof; }
+  /// Attachment gelesen; Blockerkennung ab der aktuellen Leseposition fortsetzen
+  void resumeScan();
+
+protected:
+  int_type underflow() override;
+
+private:
+  static const size_t chunk = 64 * 1024;
+  /// absolute Position des nächsten zu lesenden Bytes
+  uint64_t readPos() const { return base + uint64_t(gptr() - eback()); }
+  /// gelesene Daten verwerfen und Platz für chunk Bytes schaffen; return Beginn des freien Bereichs
+  char *reserve();
+  /// n empfangene Bytes übernehmen und untersuchen
+  void commit(size_t n);
+  void scan();
+
+  int fd;
+  vector<char> buf;
+  size_t used = 0;         // belegte Bytes in buf
+  uint64_t base = 0;       // absolute Position von buf[0]
+  uint64_t scanned = 0;    // absolute Position, bis zu der untersucht wurde
+  uint64_t completeAt = 0; // absolute Position hinter dem letzten vollständigen Block
+  bool binary = false;     // nach '\0' folgen Binärdaten
+  bool eof = false;
+  // Zustand der Tag-Erkennung
+  int depth = 0;
+  bool inTag = false;
+  bool endTag = false;
+  bool decl = false;
+  size_t tagLen = 0;
+  char quote = 0;
+  char prev = 0;
+};
+
+char *SocketInBuf::reserve() {
+  size_t consumed = size_t(gptr() - eback());
+  if (consumed) {
+    memmove(&buf[0], gptr(), used - consumed);
+    used -= consumed;
+    base += consumed;
+  }
+  if (buf.size() < used + chunk)
+    buf.resize(used + chunk);
+  setg(&buf[0], &buf[0], &buf[used]);
+  return &buf[used];
+}
+
+void SocketInBuf::commit(size_t n) {
+  used += n;
+  setg(eback(), gptr(), &buf[used]);
+  scan();
+}
+
+bool SocketInBuf::receive() {
+  while (not eof) {
+    ssize_t n = recv(fd, reserve(), chunk, MSG_DONTWAIT);
+    if (n > 0) {
+      commit(size_t(n));
+      continue;
+    }
+    if (n < 0 and errno == EINTR)
+      continue;
+    if (n < 0 and (errno == EAGAIN or errno == EWOULDBLOCK))
+      return true;
+    eof = true;
+  }
+  return false;
+}
+
+SocketInBuf::int_type SocketInBuf::underflow() {
+  while (gptr() == egptr()) {
+    if (eof)
+      return traits_type::eof();
+    ssize_t n = recv(fd, reserve(), chunk, 0);
+    if (n > 0)
+      commit(size_t(n));
+    else if (n < 0 and errno == EINTR)
+      continue;
+    else if (n < 0 and (errno == EAGAIN or errno == EWOULDBLOCK)) {
+      struct pollfd pfd{};
+      pfd.fd = fd;
+      pfd.events = POLLIN;
+      poll(&pfd, 1, -1);
+    } else
+      eof = true;
+  }
+  return traits_type::to_int_type(*gptr());
+}
+
+void SocketInBuf::resumeScan() {
+  if (not binary)
+    return;
+  binary = false;
+  depth = 1;
+  inTag = false;
+  quote = 0;
+  scanned = readPos();
+  scan();
+}
+
+void SocketInBuf::scan() {
+  for (; scanned < base + used; scanned++) {
+    if (binary) {
+      scanned = base + used;
+      break;
+    }
+    char c = buf[size_t(scanned - base)];
+    if (c == '\0') {
+      binary = true;
+      completeAt = scanned + 1;
+      continue;
+    }
+    if (not inTag) {
+      if (c == '<') {
+        inTag = true;
+        tagLen = 0;
+        quote = 0;
+        prev = 0;
       }
+      continue;
+    }
+    if (tagLen++ == 0) {
+      endTag = c == '/';
+      decl = c == '?' or c == '!';
     }
+    if (quote) {
+      if (c == quote)
+        quote = 0;
+    } else if (c == '"' or c == '\'') {
+      quote = c;
+    } else if (c == '>') {
+      inTag = false;
+      if (decl)
+        continue;
+      bool closes = endTag or prev == '/';
+      if (endTag)
+        depth--;
+      else if (not closes)
+        depth++;
+      if (closes and depth <= 1)
+        completeAt = scanned + 1;
+      continue;
+    }
+    prev = c;
   }
-  return poolCache;
 }
 
 
+/// Kennung einer parallel ausführbaren Anfrage, 0 = der Reihe nach ausführen
+static int64_t requestId(mobs::ObjectBase *obj) {
+  if (auto *s = dynamic_cast<SearchDocument *>(obj))
+    return s->reqId();
+  if (auto *g = dynamic_cast<GetDocument *>(obj))
+    return g->reqId();
+  if (auto *c = dynamic_cast<GetConfig *>(obj))
+    return c->reqId();
+  return 0;
+}
+
 // Worker-Context mit XML-Parser
 class XmlInput : public mobs::XmlReader {
 public:
-  explicit XmlInput(wistream &str, mobs::XmlWriter &res, mobs::tcpstream &tcpst, mobs::CryptIstrBuf &stbi, mobs::CryptOstrBuf &stbo, int tId,
+  explicit XmlInput(wistream &str, mobs::XmlWriter &res, SocketInBuf &in, mobs::CryptIstrBuf &stbi, mobs::CryptOstrBuf &stbo, int tId,
                     MRpcServer *s, const string &c)
-          : XmlReader(str), xmlResult(res), tcpstream(tcpst), streambufI(stbi), streambufO(stbo), taskId(tId), server(s), conName(c) { }
-  ~XmlInput() { if (ctx) ctx->release(); }
+          : XmlReader(str), xmlResult(res), inbuf(in), streambufI(stbi), streambufO(stbo), taskId(tId), server(s), conName(c) { }
+  ~XmlInput() { if (ctx) server->releaseSession(ctx); }
 
   void StartTag(const std::string &element) override {
     LOG(LM_DEBUG, "start " << element);
@@ -283,6 +823,8 @@ public:
       // Der Session-Key wird mit dem privaten Schlüssel des Clients codiert
       mobs::encryptPublicRsa(ctx->key, cipher, keyFile);
       result.key(cipher);
+      if (server->ticketLifetime > 0)
+        result.ticket(server->issueTicket(*ctx));
 
       result.traverse(xo);
 //        if (needDelimiter)
@@ -295,6 +837,9 @@ public:
         THROW("session already assigned");
       if (not ctx)
         ctx = server->getSession(sess->id());
+      // Session verfallen, verdrängt: mit Ticket ohne erneute RSA-Anmeldung wiederherstellen
+      if (not ctx and not sess->ticket().empty())
+        ctx = server->resumeSession(sess->id(), sess->ticket());
       if (not ctx) {
         LOG(LM_ERROR, "missing sessionId");
         SessionError error1;
@@ -325,31 +870,60 @@ public:
       error1.traverse(xo);
       // weiteres parsen abbrechen
       stop();
+    } else if (conn and requestId(obj) > 0) {
+      // Antworten folgen unabhängig von der Reihenfolge mit derselben reqId
+      server->dispatchRequest(conn, obj);
+      return;
     } else {
+      // der Block bleibt bis zum Ende der Antwort für parallele Anfragen gesperrt; Reihenfolge wie dort:
+      // erst stateMutex, dann writeMutex
+      std::lock_guard<std::mutex> stateLock(ctx->stateMutex);
+      std::lock_guard<std::mutex> lock(writeMutex);
       needEncryption();
 
-      ExecVisitor vi(xo, *this);
+      ExecVisitor vi(xo, *this, conName);
       try {
         obj->visit(vi);
       } catch (MrpcAccessDenied &e) {
         LOG(LM_ERROR, "MrpcAccessDenied " << e.what());
         SessionError error;
         error.error(SErrAccessDenied);
-        error.traverse(xo);
+        vi.send(error);
+      } catch (MrpcException &e) {
+        LOG(LM_ERROR, "Mrpc-Exception " << e.what());
+        SessionError error;
+        error.error(SErrUnknown);
+        error.msg(e.what());
+        vi.send(error);
+      } catch (SearchCanceled &e) {
+        LOG(LM_ERROR, "SearchCanceled " << e.what());
+        if (not e.timeout)
+          throw; // Client nicht mehr erreichbar, Verbindung verwerfen
+        SessionError error;
+        error.error(SErrTimeout);
+        vi.send(error);
       }
       if (attachmentInfo.fileSize) {
         delete obj;
         return;
       }
+      LOG(LM_INFO, "endEncryption; finish=" << finish);
+      endEncryption();
+      delete obj;
+      return;
     }
 
 
   LOG(LM_INFO, "endEncryption; finish=" << finish);
-    endEncryption();
+    {
+      std::lock_guard<std::mutex> lock(writeMutex);
+      endEncryption();
+    }
 
     delete obj;
   }
 
+  // Ausgabe nur unter writeMutex, sobald parallele Anfragen laufen können
   void endEncryption(bool sync = true) {
     if (not encryptedOutput)
       return;
@@ -373,14 +947,16 @@ public:
     xmlResult.startEncrypt(new mobs::CryptBufAes(ctx->key, iv, "", true));
     encryptedOutput = true;
   }
-  void checkStream() {
-    tcpstream.poll();
-    LOG(LM_DEBUG, "CHECK " << tcpstream.bad());
+  /// return false, wenn die Verbindung zum Client verloren ist
+  bool checkStream() {
+    bool ok = inbuf.receive();
+    LOG(LM_DEBUG, "CHECK " << not ok);
+    return ok;
   }
 
 
   mobs::XmlWriter &xmlResult;
-  mobs::tcpstream &tcpstream;
+  SocketInBuf &inbuf;
   mobs::CryptIstrBuf &streambufI;
   mobs::CryptOstrBuf &streambufO;
   int taskId;
@@ -394,6 +970,9 @@ public:
   int64_t attachmentRefId = 0;
   string attachmentError; // if set, don#t save and return this message
   string conName;
+  Connection *conn = nullptr; // nullptr: keine parallelen Anfragen
+  std::mutex writeMutex; // serialisiert die Blöcke paralleler Anfragen auf xmlResult
+  std::atomic<bool> lost{false}; // Verbindung abgebrochen; laufende parallele Anfragen beenden
 };
 
 
@@ -439,7 +1018,7 @@ void TagInfoCache::addInfo(const TemplateTagInfo &t) {
       isIdent = true;
     case TagString:
       if (not t.regex().empty())
-        formatter.insertPattern(mobs::to_wstring(t.regex()), mobs::to_wstring(t.format()));
+        formatter.insertPattern(t.regex(), t.format());
       else if (t.type() == TagString)
         doSearch = true;
       break;
@@ -450,8 +1029,7 @@ void TagInfoCache::addInfo(const TemplateTagInfo &t) {
       break;
     case TagDate:
       isDate = true;
-      formatter.insertPattern(L"([0-3]\\d).([01]\\d).([12]\\d{3})", L"%3%d-%2%02d-%1%02d");
-      formatter.insertPattern(L"([12]\\d{3})-([01]\\d)-([0-3]\\d)", L"%1%d-%2%02d-%3%02d");
+      formatter.insertDatePatterns();
       break;
     case TagDisplay:
       infoOnly = true;
@@ -465,10 +1043,10 @@ bool TagInfoCache::format(string &value) const {
     return value.empty();
   }
   if (not formatter.empty()) {
-    wstring result;
-    if (formatter.format(mobs::to_wstring(value), result)) {
-      LOG(LM_INFO, "FORMAT " << name << " " << value << " -> " << mobs::to_string(result));
-      value = mobs::to_string(result);
+    string result;
+    if (formatter.format(value, result)) {
+      LOG(LM_INFO, "FORMAT " << name << " " << value << " -> " << result);
+      value.swap(result);
       return true;
     }
     // alternativ auch Token zulassen
@@ -510,14 +1088,28 @@ void ExecVisitor::visit(mobs::ObjectBase &obj) {
   THROW("no MRpc object");
 }
 
+void ExecVisitor::write(mobs::ObjectBase &obj, bool flush) {
+  // der Reihe nach ausgeführte Anfragen halten writeMutex bereits in XmlInput::filled
+  std::unique_lock<std::mutex> lock(m_xi.writeMutex, std::defer_lock);
+  if (m_reqId)
+    lock.lock();
+  m_xi.needEncryption();
+  obj.traverse(m_xmlOut);
+  if (flush)
+    m_xi.endEncryption();
+}
+
 void ExecVisitor::visit(GetDocument &obj) {
   TRACE("");
   if (not m_xi.ctx)
     THROW("missing session context");
   // nut Dokumente aus vorheriger Query erlauben
-  if (m_xi.ctx->accessibleIds.find(obj.docId()) == m_xi.ctx->accessibleIds.end())
-    throw MrpcAccessDenied(LOGSTR("no access to Document " << obj.docId()));
-  Filestore store(m_xi.conName);
+  {
+    std::lock_guard<std::mutex> lock(m_xi.ctx->accessMutex);
+    if (m_xi.ctx->accessibleIds.find(obj.docId()) == m_xi.ctx->accessibleIds.end())
+      throw MrpcAccessDenied(LOGSTR("no access to Document " << obj.docId()));
+  }
+  Filestore store(m_conName);
   list<SearchResult> result;
   DocInfo docInfo;
   docInfo.id = obj.docId();
@@ -570,7 +1162,14 @@ void ExecVisitor::visit(GetDocument &obj) {
       doc.info.creationTime(docInfo.creation);
       doc.info.creationInfo(docInfo.creationInfo);
     }
+    if (m_reqId)
+      doc.reqId(m_reqId);
 
+    // Kopf und Attachment dürfen nicht von anderen Antworten unterbrochen werden
+    std::unique_lock<std::mutex> lock(m_xi.writeMutex, std::defer_lock);
+    if (m_reqId)
+      lock.lock();
+    m_xi.needEncryption();
     doc.traverse(m_xmlOut);
     LOG(LM_INFO, "endEncryption;");
     m_xi.endEncryption();
@@ -620,7 +1219,7 @@ void ExecVisitor::visit(GetDocument &obj) {
       doc.info.creationInfo(docInfo.creationInfo);
     }
     doc.content(std::move(buf));
-    doc.traverse(m_xmlOut);
+    send(doc);
   }
 }
 
@@ -631,28 +1230,135 @@ void ExecVisitor::visit(SearchDocument &obj) {
   LOG(LM_INFO, "COMMAND " << obj.to_string());
 
   SessionContext &context = *m_xi.ctx;
-  Filestore store(m_xi.conName);
-  if (context.tInfo.empty())
-    store.loadTemplates(context.tInfo);
-  if (context.bucketCache.empty())
-    store.loadBuckets(context.bucketCache);
-  context.accessibleIds.clear();
+  std::unique_lock<std::mutex> lock(context.stateMutex, std::defer_lock);
+  if (m_reqId)
+    lock.lock();
+  SearchCursor &sc = context.searchCursor;
+  size_t offset = obj.offset() > 0 ? size_t(obj.offset()) : 0;
+  size_t limit = obj.limit() > 0 ? size_t(obj.limit()) : 0;
+  // nur zählen: Cursor und freigegebene Dokumente der laufenden Suche bleiben erhalten
+  SearchHits countHits;
+  if (obj.countOnly())
+    search(obj, countHits);
+  else if (obj.cursor().empty()) {
+    sc.token.clear();
+    search(obj, sc.hits);
+    sc.returnTags.clear();
+    for (auto &t:obj.returnTags)
+      sc.returnTags.insert(t());
+    if (sc.returnTags.empty())
+      sc.returnTags = context.tmpl->displayTags;
+    else if (sc.returnTags.find("*") != sc.returnTags.end())
+      sc.returnTags.clear();
+    sc.orderBy = obj.orderBy();
+    sc.descending = obj.descending();
+  } else if (sc.token.empty() or sc.token != obj.cursor())
+    THROW("search cursor " << obj.cursor() << " invalid");
+  else
+    offset = sc.pos;
+
+  Filestore store(m_conName);
+  SearchDocumentResult sr;
+  const SearchHits &hits = obj.countOnly() ? countHits : sc.hits;
+  sr.total(hits.docIds.size());
+  if (obj.countOnly() or obj.cursor().empty()) {
+    for (auto &f:obj.facets) {
+      map<string, size_t> counts;
+      store.facetCounts(hits, f(), counts);
+      auto &facet = sr.facets[mobs::MemBaseVector::nextpos];
+      facet.name(f());
+      for (auto &c:counts) {
+        auto &v = facet.values[mobs::MemBaseVector::nextpos];
+        v.content(c.first);
+        v.count(c.second);
+      }
+    }
+  }
+  if (obj.countOnly()) {
+    LOG(LM_INFO, "Result: " << sr.to_string());
+    send(sr);
+    return;
+  }
+  vector<DocId> page;
+  if (sc.orderBy.empty()) {
+    if (offset < sc.hits.docIds.size())
+      page.assign(sc.hits.docIds.begin() + offset,
+                  limit ? sc.hits.docIds.begin() + min(offset + limit, sc.hits.docIds.size()) : sc.hits.docIds.end());
+  } else {
+    // nur die ersten offset + limit Treffer ordnen
+    store.orderHits(sc.hits, sc.orderBy, sc.descending, limit ? offset + limit : 0, page);
+    page.erase(page.begin(), page.begin() + min(offset, page.size()));
+  }
+  vector<SearchResultDoc> result = store.loadHits(sc.hits, page, sc.returnTags);
+  sc.pos = offset + result.size();
+  if (limit and sc.pos < sc.hits.docIds.size()) {
+    sc.token = std::to_string(++sc.cntr);
+    sr.cursor(sc.token);
+  } else {
+    // Suche vollständig ausgeliefert
+    sc.token.clear();
+    sc.hits.docIds.clear();
+    sc.hits.primIds.clear();
+  }
+
+  {
+    // erst mit dem neuen Ergebnis austauschen, damit Dokumente der vorherigen Suche abrufbar bleiben
+    std::lock_guard<std::mutex> accessLock(context.accessMutex);
+    if (obj.cursor().empty())
+      context.accessibleIds.clear();
+    for (auto &doc:result)
+      context.accessibleIds.insert(doc.docId);
+  }
+  map<TagId, string> tagNames;  // TODO cache in tagSearch mitverwenden
+  for (auto &doc:result) {
+    auto &r = sr.tags[mobs::MemBaseVector::nextpos];
+    r.docId(doc.docId);
+    if (doc.primary) {
+      auto &inf = r.tags[mobs::MemBaseVector::nextpos];
+      inf.name("prim$$");
+      inf.content("");
+    }
+    for (auto &t:doc.tags) {
+      auto tn = tagNames.find(t.tagId);
+      if (tn == tagNames.end())
+        tn = tagNames.emplace(t.tagId, store.tagName(t.tagId)).first;
+//      if (tn->second == "$creation") {
+//        mobs::MTime t;
+//        if (mobs::string2x(t.tagContent, t))
+//         r.creationTime(t);
+//        continue;
+//      }
+      auto &inf = r.tags[mobs::MemBaseVector::nextpos];
+      inf.name(tn->second);
+      inf.content(t.tagContent);
+    }
+  }
+
+  LOG(LM_INFO, "Result: " << sr.to_string());
+  send(sr);
+}
+
+void ExecVisitor::search(SearchDocument &obj, SearchHits &hits) {
+  SessionContext &context = *m_xi.ctx;
+  Filestore store(m_conName);
+  context.useConfig(m_xi.server->config());
 
   // TODO Template prüfen (=Rechte), fixed Tags hinzu
   string pool = context.setTemplate(obj.templateName());
 
   if (pool.empty())
     THROW("template " << obj.templateName() << " invalid");
-  auto const bucketIt = context.bucketCache.find(pool);
+  auto const bucketIt = context.config->buckets.find(pool);
 
   map<string, TagSearch> tagSearch;
   for (auto i:obj.tags) {
-    auto f = context.tagInfoCache.find(i.name());
-    bool search = (f != context.tagInfoCache.end() and f->second.doSearch);
+    auto f = context.tagInfo(i.name());
+    bool search = (f and f->doSearch);
     string id = i.name();
     id += string(search ? "$$" : "");
+    // das Präfix bestimmt die Reihenfolge nur noch bei gleicher Schätzung des Planers in Filestore::searchHits
     string key = "A";
-    if (bucketIt != context.bucketCache.end() and bucketIt->second.isBucketTag(i.name()))
+    if (bucketIt != context.config->buckets.end() and bucketIt->second.isBucketTag(i.name()))
       key = "Z";  // Buckets immer am Ende der Suchliste
 
     auto c = i.content();
@@ -686,6 +1392,15 @@ void ExecVisitor::visit(SearchDocument &obj) {
           tagSearch[key + cnt].tagName = id;
           cnt++;
         }
+        else if (o == "*") { // Teilwortsuche
+          // ohne Trigramm wäre das ein LIKE '%x%' über alle Tags des Pools
+          if (result.length() < 3)
+            throw MrpcException(STRSTR("TERM TOO SHORT " << i.name()));
+          key[0] = 'M';
+          tagSearch[key + cnt].tagOpList.emplace(result, "CONTAINS");
+          tagSearch[key + cnt].tagName = id;
+          cnt++;
+        }
         else {
           key[0] = 'M';
           tagSearch[key + cnt].tagOpList.emplace(result, o);
@@ -709,7 +1424,7 @@ void ExecVisitor::visit(SearchDocument &obj) {
 
   bool primarySearch = false;
   set<int> buckets;
-  if (bucketIt != context.bucketCache.end()) {
+  if (bucketIt != context.config->buckets.end()) {
     map<int, TagSearch> tagSearchBuckets;
     for (auto &i:tagSearch) {
       TagSearch tagResult;
@@ -738,56 +1453,30 @@ void ExecVisitor::visit(SearchDocument &obj) {
     buckets.insert(0);
   int percent = 0;
   std::chrono::system_clock::time_point last = std::chrono::system_clock::now();
-  list<SearchResult> result = store.searchTags(pool, tagSearch, buckets, context.cacheGroupName,
-                                               [this, &percent, &last](int p)
-                                               {
-                                                 m_xi.checkStream();
-                                                 if (p > percent) {
-                                                   std::chrono::system_clock::time_point now = std::chrono::system_clock::now();
-                                                   if (std::chrono::duration_cast<std::chrono::milliseconds>(now - last).count() > 900) {
-                                                     Progress pr;
-                                                     pr.percent(p);
-                                                     pr.traverse(m_xmlOut);
-                                                     m_xi.endEncryption();
-                                                     m_xi.needEncryption();
-                                                     percent = p;
-                                                     last = now;
-                                                     LOG(LM_INFO, "PERCENT " << p);
-                                                   }
-                                                 }
-                                               });
-
-  map<TagId, string> tagNames;  // TODO cache in tagSearch mitverwenden
-  tagNames[0] = "prim$$";
-  SearchDocumentResult sr;
-  set<int> skip;
-  for (auto it = result.cbegin(); it != result.cend(); it++) {
-    if (skip.find(it->docId) != skip.end())
-      continue;
-    skip.insert(it->docId);
-    auto &r = sr.tags[mobs::MemBaseVector::nextpos];
-    r.docId(it->docId);
-    context.accessibleIds.insert(it->docId);
-    for (auto it2 = it; it2 != result.cend(); it2++) {
-      if (it2->docId == it->docId) {
-        auto tn = tagNames.find(it2->tagId);
-        if (tn == tagNames.end())
-          tn = tagNames.emplace(it2->tagId, store.tagName(it2->tagId)).first;
-//        if (tn->second == "$creation") {
-//          mobs::MTime t;
-//          if (mobs::string2x(it2->tagContent, t))
-//           r.creationTime(t);
-//          continue;
-//        }
-        auto &inf = r.tags[mobs::MemBaseVector::nextpos];
-        inf.name(tagNames[it2->tagId]);
-        inf.content(it2->tagContent);
-      }
-    }
-  }
-
-  LOG(LM_INFO, "Result: " << sr.to_string());
-  sr.traverse(m_xmlOut);
+  CancelToken cancel;
+  if (m_xi.server->searchTimeout > 0)
+    cancel.setTimeout(std::chrono::seconds(m_xi.server->searchTimeout));
+  store.searchHits(pool, tagSearch, buckets, context.groupName(),
+                   [this, &percent, &last, &cancel](int p)
+                   {
+                     // parallel zum Parser darf der Stream nicht gepollt werden
+                     if (m_xi.lost or (not m_reqId and not m_xi.checkStream())) {
+                       LOG(LM_ERROR, "connection lost, cancel search");
+                       cancel.cancel();
+                       return;
+                     }
+                     if (p > percent) {
+                       std::chrono::system_clock::time_point now = std::chrono::system_clock::now();
+                       if (std::chrono::duration_cast<std::chrono::milliseconds>(now - last).count() > 900) {
+                         Progress pr;
+                         pr.percent(p);
+                         send(pr, true);
+                         percent = p;
+                         last = now;
+                         LOG(LM_INFO, "PERCENT " << p);
+                       }
+                     }
+                   }, cancel, hits);
 }
 
 void ExecVisitor::visit(SaveDocument &obj) {
@@ -799,14 +1488,13 @@ void ExecVisitor::visit(SaveDocument &obj) {
   m_xi.attachmentError.clear();
   m_xi.attachmentRefId = obj.refId();
   try {
-    SessionContext &context = *m_xi.ctx;
-    Filestore store(m_xi.conName);
-    if (context.tInfo.empty())
-      store.loadTemplates(context.tInfo);
-    if (context.bucketCache.empty())
-      store.loadBuckets(context.bucketCache);
+    Filestore store(m_conName);
+    // Template nur lokal bestimmen, damit parallel laufende Suchen der Session unberührt bleiben
+    auto config = m_xi.server->config();
     // TODO Template prüfen (=Rechte), fixed Tags hinzu, nur Systemuser darf ohne Template speichern
-    string pool = context.setTemplate(obj.templateName());
+    auto tmplIt = config->templateCache.find(obj.templateName());
+    const TemplateCache *tmpl = tmplIt == config->templateCache.end() ? nullptr : &tmplIt->second;
+    string pool = tmpl ? tmpl->pool : "";
     if (pool.empty())
       pool = obj.pool();
 
@@ -816,10 +1504,10 @@ void ExecVisitor::visit(SaveDocument &obj) {
     }
 
     TagId groupId = 0;
-    if (not context.cacheGroupName.empty())
-      groupId = store.findTag(pool, context.cacheGroupName);
+    if (tmpl and not tmpl->groupName.empty())
+      groupId = store.findTag(pool, tmpl->groupName);
 
-    auto const bucketIt = context.bucketCache.find(pool);
+    auto const bucketIt = config->buckets.find(pool);
 
     docInfo.creation = obj.creationTime();
     docInfo.creationInfo = obj.creationInfo();
@@ -855,12 +1543,12 @@ void ExecVisitor::visit(SaveDocument &obj) {
       for (auto &t:obj.tags) {
         string value = t.content();
         if (not obj.templateName().empty()) {
-          auto f = context.tagInfoCache.find(t.name());
-          if (f != context.tagInfoCache.end()) {
-            if (not f->second.format(value)) {
+          auto f = tmpl ? tmpl->find(t.name()) : nullptr;
+          if (f) {
+            if (not f->format(value)) {
               LOG(LM_ERROR, "format failed " << t.name());
               throw MrpcException(STRSTR("BAD TAG " << t.name()));
-            } else if (f->second.doSearch) {
+            } else if (f->doSearch) {
               wstring n = mobs::to_wstring(value);
               std::wstring::const_iterator it = n.begin();
               while (it != n.end()) {
@@ -877,10 +1565,10 @@ void ExecVisitor::visit(SaveDocument &obj) {
       }
       std::list<TagInfo> tagInfo;
       std::string creat;
-      if (context.tagInfoCache.find("$creation") != context.tagInfoCache.end())
+      if (tmpl and tmpl->find("$creation"))
         creat = mobs::to_string_gmt(docInfo.creation);
 
-      if (bucketIt != context.bucketCache.cend()) {
+      if (bucketIt != config->buckets.cend()) {
         // Bucket auf Vollständigkeit prüfen
         vector<string> buckTok;
         set<int> prioCheck;
@@ -927,7 +1615,7 @@ void ExecVisitor::visit(SaveDocument &obj) {
           store.insertTag(tagInfo, pool, "$creation", creat);
         }
 
-      store.newDocument(docInfo, tagInfo, 0/*groupId*/);
+      store.newDocument(docInfo, tagInfo, groupId);
     }
   } catch (MrpcException &e) {
     LOG(LM_ERROR, "Mrpc-Exception " << e.what());
@@ -942,17 +1630,15 @@ void ExecVisitor::visit(SaveDocument &obj) {
 void ExecVisitor::visit(GetConfig &obj) {
   if (not m_xi.ctx)
     THROW("missing session context");
-  SessionContext &context = *m_xi.ctx;
-  Filestore store(m_xi.conName);
   ConfigResult co;
-  context.tInfo.clear();
-  store.loadTemplates(context.tInfo);
+  // ohne Session-Zustand, damit GetConfig nicht auf eine laufende Suche wartet
+  auto config = m_xi.server->config();
   // TODO Rechte filtern: nur erlaubte Templates liefern
-  for (auto t:context.tInfo) {
+  for (auto &t:config->templates) {
     co.templates[mobs::MemBaseVector::nextpos].doCopy(t);
   }
   LOG(LM_INFO, "Result: " << co.to_string());
-  co.traverse(m_xmlOut);
+  send(co);
 }
 
 void ExecVisitor::visit(Ping &obj) {
@@ -960,7 +1646,7 @@ void ExecVisitor::visit(Ping &obj) {
     THROW("missing session context");
   LOG(LM_INFO, "Send duplicate");
   obj.cnt(obj.cnt()+1);
-  obj.traverse(m_xmlOut);
+  write(obj, false);
 }
 
 void ExecVisitor::visit(GetPub &obj) {
@@ -968,14 +1654,14 @@ void ExecVisitor::visit(GetPub &obj) {
     THROW("missing session context");
   LOG(LM_INFO, "Send public key");
   //obj.cnt(obj.cnt()+1);
-  obj.traverse(m_xmlOut);
+  write(obj, false);
 }
 
 void ExecVisitor::visit(Dump &obj) {
   if (not m_xi.ctx)
     THROW("missing session context");
   LOG(LM_INFO, "Dump DB");
-  Filestore store(m_xi.conName);
+  Filestore store(m_conName);
   std::vector<DocId> result;
   store.allDocs(result);
   for (auto i:result) {
@@ -984,7 +1670,6 @@ void ExecVisitor::visit(Dump &obj) {
     gd.allowAttach(true);
     gd.allInfos(true);
 
-    m_xi.needEncryption();
     visit(gd);
   }
 
@@ -992,132 +1677,379 @@ void ExecVisitor::visit(Dump &obj) {
 }
 
 
+/// Kontext einer Client-Verbindung; bleibt erhalten, während die Verbindung im Reactor auf Daten wartet
+class Connection {
+public:
+  explicit Connection(MRpcServer *s) : xstream(s->tcpAccept), inbuf(socketOf(xstream)), instream(&inbuf),
+                                       streambufI(instream), x2in(&streambufI),
+                                       streambufO(xstream), x2out(&streambufO),
+                                       xf(x2out, mobs::XmlWriter::CS_utf8, true),
+                                       xr(x2in, xf, inbuf, streambufI, streambufO, -1, s, "") {
+    xstream.exceptions(std::iostream::failbit | std::iostream::badbit);
+    if (not xstream.is_open())
+      throw runtime_error("connection failed");
+    LOG(LM_INFO, "Remote: " << xstream.getRemoteHost() << " " << xstream.getRemoteIp());
+    streambufI.getCbb()->setReadDelimiter('\0');
+    xr.conn = this;
+    // Writer-Klasse mit File, und Optionen initialisieren
+    xf.writeHead();
+    xf.writeTagBegin(L"methodResponse");
+    // XML-Parser erledigt die eigentliche Arbeit in seinen Callback-Funktionen
+    xr.readTillEof(false);
+  }
+
+  /// einen Block verarbeiten; return false, wenn die Übertragung beendet ist
+  bool process();
+  /// Übertragung beenden und Verbindung schließen
+  void finish();
+  /// parallele Anfrage mit der DB-Verbindung des Workers ausführen; übernimmt obj
+  void execute(mobs::ObjectBase *obj, const string &conName);
+  /// Referenz abgeben; die letzte beendet die Übertragung, falls closing gesetzt, und löscht die Verbindung
+  static void release(Connection *c);
+  /// es liegt bereits ein vollständiger Block im Puffer oder die Verbindung ist beendet
+  bool pending() { return x2in.rdbuf()->in_avail() > 0 or inbuf.complete() or inbuf.closed(); }
+  int socket() { return socketOf(xstream); }
+  static int socketOf(mobs::tcpstream &s) {
+    auto *tp = dynamic_cast<mobs::TcpStBuf *>(s.rdbuf());
+    return tp ? tp->getSocket() : -1;
+  }
+
+  mobs::tcpstream xstream; // nur Ausgabe, gelesen wird über inbuf
+  SocketInBuf inbuf;
+  std::istream instream;
+  mobs::CryptIstrBuf streambufI;
+  std::wistream x2in;
+  mobs::CryptOstrBuf streambufO;
+  std::wostream x2out;
+  mobs::XmlWriter xf;
+  XmlInput xr;
+  std::atomic<int> refs{1}; // Reactor bzw. lesender Worker und je eine je laufender paralleler Anfrage
+  std::atomic<bool> closing{false}; // Eingabe vollständig, nach der letzten Anfrage schließen
+};
+
+
 #define TLOG(l, x) LOG(l, 'T' << id << ' ' << x)
 
-void MRpcServer::worker_thread(int id, MRpcServer *server) {
-  string con = "docsrv";
-  if (id > 0)
-    con += to_string(id);
+bool Connection::process() {
+  int id = xr.taskId;
+  // Input parsen
+  xr.parse();
+  TLOG(LM_INFO, "XIN bad=" << instream.bad() << " eof=" << instream.eof() << " closed=" << inbuf.closed() << " eot="
+                           << xr.eot());
+  if (xr.attachmentInfo.fileSize) {
+    LOG(LM_INFO, "Do attachment " << xr.attachmentInfo.id << " size=" << xr.attachmentInfo.fileSize << " " << AES_BYTES(xr.attachmentInfo.fileSize));
+    vector<u_char> iv;
+    iv.resize(mobs::CryptBufAes::iv_size());
+    mobs::CryptBufAes::getRand(iv);
+    mobs::CryptBufAes cry(xr.ctx->key, iv, "", true);
+//          xstream.unsetf(std::ios::skipws);
+    auto delim = instream.get();
+    if (delim != 0) {
+      LOG(LM_ERROR, "Delimiter is " << int(delim) << " " << (char) delim);
+      throw runtime_error("delimiter missing");
 
-  for (;;) {
-    try {
-      TLOG(LM_INFO, "WAITING");
-      mobs::tcpstream xstream(server->tcpAccept);
-      xstream.exceptions(std::iostream::failbit | std::iostream::badbit);
-      LOG(LM_INFO, "Remote: " << xstream.getRemoteHost() << " " << xstream.getRemoteIp());
+//            delim = xstream.get();
+    }
+    cry.setIstr(instream);
+    mobs::ConvObjToString cth;
+    mobs::XmlOut xo(&xf, cth);
+
+    cry.setReadLimit(AES_BYTES(xr.attachmentInfo.fileSize));
+    cry.hashAlgorithm("sha1");
+    istream istr(&cry);
+
+    Filestore store(xr.conName);
+
+    if (xr.attachmentError.empty()) {
+      xr.attachmentInfo.fileName = store.writeFile(istr, xr.attachmentInfo);
+      xr.attachmentInfo.checkSum = cry.hashStr();
+      LOG(LM_INFO, "HASH " << cry.hashStr());
+      store.documentCreated(xr.attachmentInfo);
+      if (cry.bad())
+        THROW("error while encrypting attachment");
+      LOG(LM_INFO, "Attachment saved");
+    } else {
+      xr.attachmentInfo.id = 0;
+      // skip attachment
+      size_t c = 0;
+      char ch;
+      while (not istr.get(ch).eof()) c++;
+      LOG(LM_INFO, "HASH " << cry.hashStr() << " " << c);
+      if (cry.bad())
+        THROW("error while encrypting attachment");
+      LOG(LM_INFO, "Attachment skipped");
+    }
+    xr.attachmentInfo.fileSize = 0;
+    inbuf.resumeScan();
+
+    CommandResult doc;
+    doc.docId(xr.attachmentInfo.id);
+    doc.refId(xr.attachmentRefId);
+    if (xr.attachmentError.empty())
+      doc.msg("OK");
+    else
+      doc.msg(xr.attachmentError);
 
-      if (not xstream.is_open())
-        throw runtime_error("connection failed");
+    // parallele Anfragen können den Block inzwischen beendet haben
+    std::lock_guard<std::mutex> lock(xr.writeMutex);
+    xr.needEncryption();
+    doc.traverse(xo);
 
-      TLOG(LM_INFO, "OK");
+//          xstream.setf(std::ios::skipws);
+    LOG(LM_INFO, "endEncryption; finish=" << xr.finish);
+    xr.endEncryption();
+  }
+  // nur den Eingabepuffer prüfen, der Ausgabestrom gehört unter writeMutex den parallelen Anfragen
+  LOG(LM_INFO, "CHECK STATE " << instream.bad());
+  if (instream.bad())  // TODO iostream-exception
+    throw runtime_error("stream lost");
+  return not xr.finish and not xr.eot();
+}
 
-      mobs::CryptIstrBuf streambufI(xstream);
-      streambufI.getCbb()->setReadDelimiter('\0');
-      std::wistream x2in(&streambufI);
+void Connection::finish() {
+  int id = xr.taskId;
+  TLOG(LM_INFO, "parsing done");
+
+  // transmission ends
+  xf.writeTagEnd();
+  LOG(LM_INFO, "ENDE");
+  streambufO.finalize();
+  xstream.shutdown();
+  TLOG(LM_INFO, "closing good=" << xstream.good());
+  xstream.close();
+}
 
-      // Output Stream initialisiert
-      mobs::CryptOstrBuf streambufO(xstream);
-      std::wostream x2out(&streambufO);
-      // Writer-Klasse mit File, und Optionen initialisieren
-      mobs::XmlWriter xf(x2out, mobs::XmlWriter::CS_utf8, true);
-      xf.writeHead();
-      xf.writeTagBegin(L"methodResponse");
+void Connection::execute(mobs::ObjectBase *obj, const string &conName) {
+  std::unique_ptr<mobs::ObjectBase> request(obj);
+  int64_t reqId = requestId(obj);
+  LOG(LM_INFO, "REQUEST " << reqId << " " << obj->getObjectName());
+  mobs::ConvObjToString cth;
+  mobs::XmlOut xo(&xf, cth);
+  ExecVisitor vi(xo, xr, conName, reqId);
+  SessionError error;
+  try {
+    if (xr.lost)
+      return;
+    obj->visit(vi);
+    return;
+  } catch (MrpcAccessDenied &e) {
+    LOG(LM_ERROR, "MrpcAccessDenied " << e.what());
+    error.error(SErrAccessDenied);
+  } catch (SearchCanceled &e) {
+    LOG(LM_ERROR, "SearchCanceled " << e.what());
+    if (not e.timeout)
+      return;
+    error.error(SErrTimeout);
+  } catch (exception &e) {
+    LOG(LM_ERROR, "Request Exception " << e.what());
+    error.error(SErrUnknown);
+    error.msg(e.what());
+  }
+  try {
+    vi.send(error);
+  } catch (exception &e) {
+    LOG(LM_ERROR, "Request Exception " << e.what());
+    xr.lost = true;
+  }
+}
 
+void Connection::release(Connection *c) {
+  if (--c->refs > 0)
+    return;
+  if (c->closing and not c->xr.lost) {
+    try {
+      c->finish();
+    } catch (exception &e) {
+      LOG(LM_ERROR, "Finish Exception " << e.what());
+    }
+  }
+  delete c;
+}
 
-//      cout << "TTT " << std::boolalpha << x2out.fail() << " " << x2out.tellp() << endl;
 
-//    x2out << mobs::CryptBufBase::base64(true);
+void MRpcServer::startWorker() {
+  int id;
+  if (not freeWorkerIds.empty()) {
+    id = *freeWorkerIds.begin();
+    freeWorkerIds.erase(freeWorkerIds.begin());
+  } else {
+    id = workerIdCntr++;
+    // jeder Worker erhält seine eigene Datenbank-Verbindung
+    if (id > 0)
+      Filestore::newDbInstance(STRSTR("docsrv" << id));
+  }
+  numWorker++;
+  idleWorker++;
+  LOG(LM_INFO, "start worker " << id << " running " << numWorker);
+  std::thread t(worker_thread, id, this);
+  t.detach();
+}
 
+bool MRpcServer::nextJob(int id, Job &job) {
+  std::unique_lock<std::mutex> lock(mw);
+  while (readyJobs.empty()) {
+    // überzählige Worker nach einer Minute Leerlauf beenden
+    if (cvWorker.wait_for(lock, std::chrono::seconds(60)) == std::cv_status::timeout and
+        readyJobs.empty() and numWorker > minWorker) {
+      numWorker--;
+      idleWorker--;
+      freeWorkerIds.insert(id);
+      LOG(LM_INFO, "stop worker " << id << " running " << numWorker);
+      return false;
+    }
+  }
+  idleWorker--;
+  job = readyJobs.front();
+  readyJobs.pop_front();
+  return true;
+}
 
-      // XML-Parser erledigt die eigentliche Arbeit in seinen Callback-Funktionen
-      XmlInput xr(x2in, xf, xstream, streambufI, streambufO, id, server, con);
-      xr.readTillEof(false);
+void MRpcServer::workerIdle() {
+  std::lock_guard<std::mutex> lock(mw);
+  idleWorker++;
+}
 
+void MRpcServer::enqueue(const Job &job) {
+  readyJobs.push_back(job);
+  // mehr wartende Aufträge als freie Worker -> Pool vergrößern
+  if (int(readyJobs.size()) > idleWorker and numWorker < maxWorker)
+    startWorker();
+  cvWorker.notify_one();
+}
 
-      do {
-        // Input parsen
-        xr.parse();
-        TLOG(LM_INFO, "XIN bad=" << xstream.bad() << " eof=" << xstream.eof() << " read=" << xstream.tellg() << " eot="
-                                 << xr.eot());
-        if (xr.attachmentInfo.fileSize) {
-          LOG(LM_INFO, "Do attachment " << xr.attachmentInfo.id << " size=" << xr.attachmentInfo.fileSize << " " << AES_BYTES(xr.attachmentInfo.fileSize));
-          vector<u_char> iv;
-          iv.resize(mobs::CryptBufAes::iv_size());
-          mobs::CryptBufAes::getRand(iv);
-          mobs::CryptBufAes cry(xr.ctx->key, iv, "", true);
-//          xstream.unsetf(std::ios::skipws);
-          auto delim = xstream.get();
-          if (delim != 0) {
-            LOG(LM_ERROR, "Delimiter is " << int(delim) << " " << (char) delim);
-            throw runtime_error("delimiter missing");
+void MRpcServer::dispatch(Connection *c) {
+  std::lock_guard<std::mutex> lock(mw);
+  Job job;
+  job.conn = c;
+  enqueue(job);
+}
 
-//            delim = xstream.get();
-          }
-          cry.setIstr(xstream);
-          mobs::ConvObjToString cth;
-          mobs::XmlOut xo(&xf, cth);
-
-          cry.setReadLimit(AES_BYTES(xr.attachmentInfo.fileSize));
-          cry.hashAlgorithm("sha1");
-          istream istr(&cry);
-
-          Filestore store(xr.conName);
-
-          if (xr.attachmentError.empty()) {
-            xr.attachmentInfo.fileName = store.writeFile(istr, xr.attachmentInfo);
-            xr.attachmentInfo.checkSum = cry.hashStr();
-            LOG(LM_INFO, "HASH " << cry.hashStr());
-            store.documentCreated(xr.attachmentInfo);
-            if (cry.bad())
-              THROW("error while encrypting attachment");
-            LOG(LM_INFO, "Attachment saved");
-          } else {
-            xr.attachmentInfo.id = 0;
-            // skip attachment
-            size_t c = 0;
-            char ch;
-            while (not istr.get(ch).eof()) c++;
-            LOG(LM_INFO, "HASH " << cry.hashStr() << " " << c);
-            if (cry.bad())
-              THROW("error while encrypting attachment");
-            LOG(LM_INFO, "Attachment skipped");
-          }
-          xr.attachmentInfo.fileSize = 0;
-
-          CommandResult doc;
-          doc.docId(xr.attachmentInfo.id);
-          doc.refId(xr.attachmentRefId);
-          if (xr.attachmentError.empty())
-            doc.msg("OK");
-          else
-            doc.msg(xr.attachmentError);
-
-          doc.traverse(xo);
+void MRpcServer::dispatchRequest(Connection *c, mobs::ObjectBase *obj) {
+  c->refs++;
+  std::lock_guard<std::mutex> lock(mw);
+  Job job;
+  job.conn = c;
+  job.request = obj;
+  enqueue(job);
+}
 
-//          xstream.setf(std::ios::skipws);
-          LOG(LM_INFO, "endEncryption; finish=" << xr.finish);
-          xr.endEncryption();
-        }
-        if (auto *tp = dynamic_cast<mobs::TcpStBuf *>(xstream.rdbuf())) {
-          LOG(LM_INFO, "CHECK STATE " << tp->bad());
-          if (tp->bad())  // TODO iostream-exception
-            throw runtime_error("stream lost");
-        }
-      } while (not xr.finish and not xr.eot());
-      TLOG(LM_INFO, "parsing done");
-
-      // transmission ends
-      xf.writeTagEnd();
-      LOG(LM_INFO, "ENDE");
-      streambufO.finalize();
-      xstream.shutdown();
-      TLOG(LM_INFO, "closing good=" << xstream.good());
-      xstream.close();
+void MRpcServer::park(Connection *c) {
+#ifdef __linux__
+  int fd = c->socket();
+  if (fd >= 0) {
+    {
+      std::lock_guard<std::mutex> lock(mr);
+      parkedConnections[fd] = c;
+    }
+    struct epoll_event ev{};
+    ev.events = EPOLLIN | EPOLLRDHUP | EPOLLONESHOT;
+    ev.data.fd = fd;
+    if (epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &ev) == 0)
+      return;
+    LOG(LM_ERROR, "epoll_ctl " << strerror(errno));
+    std::lock_guard<std::mutex> lock(mr);
+    parkedConnections.erase(fd);
+  }
+#endif
+  // ohne Reactor wartet der Worker selbst auf Daten
+  dispatch(c);
+}
+
+void MRpcServer::reactor_thread(MRpcServer *server) {
+#ifdef __linux__
+  // solange kein Block vollständig ist, bleibt die Verbindung geparkt; ab dieser Größe trotzdem übergeben
+  const size_t maxBuffered = 1024 * 1024;
+  std::array<struct epoll_event, 64> events{};
+  for (;;) {
+    int n = epoll_wait(server->epollFd, &events[0], int(events.size()), -1);
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      LOG(LM_ERROR, "epoll_wait " << strerror(errno));
+      return;
+    }
+    for (int i = 0; i < n; i++) {
+      int fd = events[i].data.fd;
+      Connection *c = nullptr;
+      {
+        std::lock_guard<std::mutex> lock(server->mr);
+        auto it = server->parkedConnections.find(fd);
+        if (it != server->parkedConnections.end())
+          c = it->second;
+      }
+      if (not c) {
+        epoll_ctl(server->epollFd, EPOLL_CTL_DEL, fd, nullptr);
+        continue;
+      }
+      // alles Anliegende in den Puffer der Verbindung übernehmen, damit ein erneutes Scharfschalten erst bei
+      // neuen Daten feuert
+      if (c->inbuf.receive() and not (events[i].events & (EPOLLHUP | EPOLLERR)) and not c->inbuf.complete() and
+          c->inbuf.unread() < maxBuffered) {
+        struct epoll_event ev{};
+        ev.events = EPOLLIN | EPOLLRDHUP | EPOLLONESHOT;
+        ev.data.fd = fd;
+        if (epoll_ctl(server->epollFd, EPOLL_CTL_MOD, fd, &ev) == 0)
+          continue;
+        LOG(LM_ERROR, "epoll_ctl " << strerror(errno));
+      }
+      {
+        std::lock_guard<std::mutex> lock(server->mr);
+        server->parkedConnections.erase(fd);
+      }
+      epoll_ctl(server->epollFd, EPOLL_CTL_DEL, fd, nullptr);
+      // Verbindung beendet, ohne dass der letzte Block angekommen ist
+      if (c->inbuf.closed() and not c->inbuf.complete())
+        c->xr.lost = true;
+      server->dispatch(c);
+    }
+  }
+#endif
+}
+
+void MRpcServer::worker_thread(int id, MRpcServer *server) {
+  string con = "docsrv";
+  if (id > 0)
+    con += to_string(id);
+
+  for (;;) {
+    TLOG(LM_INFO, "WAITING");
+    Job job;
+    if (not server->nextJob(id, job))
+      return;
+    Connection *c = job.conn;
+    if (job.request) {
+      c->execute(job.request, con);
+      Connection::release(c);
+      server->workerIdle();
+      continue;
+    }
+    c->xr.taskId = id;
+    c->xr.conName = con;
+    try {
+      bool more;
+      do {
+        more = c->process();
+      } while (more and c->pending() and not c->inbuf.closed());
+      if (c->inbuf.closed() and not (c->xr.finish or c->xr.eot())) {
+        // Gegenstelle hat vor dem letzten Block beendet; laufende parallele Anfragen abbrechen
+        TLOG(LM_ERROR, "connection closed by peer");
+        c->xr.lost = true;
+      } else if (more) {
+        // Client wartet; Verbindung bis zum nächsten Block abgeben
+        server->park(c);
+        c = nullptr;
+      } else
+        c->closing = true;
     } catch (mobs::tcpstream::failure &e) {
       TLOG(LM_ERROR, "Worker File-Exception " << e.what());
+      c->xr.lost = true;
     } catch (exception &e) {
       TLOG(LM_ERROR, "Worker Exception " << e.what());
+      c->xr.lost = true;
     }
+    if (c)
+      Connection::release(c);
+    server->workerIdle();
   }
 }
 
@@ -1125,26 +2057,49 @@ void MRpcServer::server() {
   if (tcpAccept.initService(service) < 0)
     THROW("Service not started");
 
-  Filestore::newDbInstance("docsrv1");
-  Filestore::newDbInstance("docsrv2");
-
-  // TODO zu Debug-Zweckem keine Threads
-  std::thread t1(worker_thread, 1, this);
-  std::thread t2(worker_thread, 2, this);
-  worker_thread(0, this);
-
-  t1.join();
-  t2.join();
-
-
-
-
+  if (minWorker < 1)
+    minWorker = 1;
+  if (maxWorker < minWorker)
+    maxWorker = minWorker;
+  LOG(LM_INFO, "worker pool " << minWorker << " - " << maxWorker);
+  Filestore::newDbInstance("docsrvhk");
+  reloadConfig(true);
+  ticketKey.resize(mobs::CryptBufAes::key_size());
+  mobs::CryptBufAes::getRand(ticketKey);
+  ticketMacKey.resize(32);
+  mobs::CryptBufAes::getRand(ticketMacKey);
+
+#ifdef __linux__
+  epollFd = epoll_create1(0);
+  if (epollFd < 0)
+    THROW("epoll_create failed " << strerror(errno));
+  std::thread reactor(reactor_thread, this);
+  reactor.detach();
+#endif
+  {
+    std::lock_guard<std::mutex> lock(mw);
+    for (int i = 0; i < minWorker; i++)
+      startWorker();
+  }
+  std::thread housekeeping(housekeeping_thread, this);
+  housekeeping.detach();
 
+  for (;;) {
+    try {
+      LOG(LM_INFO, "WAITING");
+      // neue Verbindungen warten im Reactor auf ihren ersten Block
+      park(new Connection(this));
+    } catch (mobs::tcpstream::failure &e) {
+      LOG(LM_ERROR, "Accept File-Exception " << e.what());
+    } catch (exception &e) {
+      LOG(LM_ERROR, "Accept Exception " << e.what());
+    }
+  }
 }
 
 
 void usage() {
-  cerr << "usage: mrpcsrv [-g] [-b base]\n"
+  cerr << "usage: mrpcsrv [-g] [-b base] [-t min[:max]] [-s n] [-d sec] [-e sec] [-k sec] [-m MB] [-C MB] [-i] [-T]\n"
        << "       mrpcsrv -a privatKeyFile -u username\n"
        << " -P Port default = '4444'\n"
        << " -b base dir default = 'DocSrvFiles'\n"
@@ -1152,7 +2107,17 @@ void usage() {
        << " -c configfile lese Config aus Datei in DB und beende\n"
        << " -a pem-file -u userName add new public key and user\n"
        << " -g generate key and exit\n"
-       << " -v Debug-Level\n";
+       << " -t min[:max] Anzahl Worker-Threads default = 3\n"
+       << " -s Anzahl Threads für parallele Suche über mehrere Buckets default = 4, 0 = aus\n"
+       << " -d Sekunden bis zum Abbruch einer Suche default = 120, 0 = unbegrenzt\n"
+       << " -e Sekunden bis unbenutzte Sessions verfallen default = 3600\n"
+       << " -k Sekunden, die eine Session per Ticket ohne neue Anmeldung wiederhergestellt werden kann default = 86400, 0 = aus\n"
+       << " -m Speicherbudget für Sessions in MB default = 256\n"
+       << " -C Speicherbudget für den Cache von Suchergebnissen in MB default = 0 (aus, nur bei einem Server je DB)\n"
+       << " -i In-Memory-Index für Tag-Suche und Gruppen (nur bei einem Server je DB)\n"
+       << " -T Trigramm-Index für Teilwortsuche aus bestehenden Daten neu aufbauen und beenden\n"
+       << " -v Debug-Level\n"
+       << " SIGHUP lädt Templates und Buckets neu, Änderungen durch -c werden nach spätestens 60s übernommen\n";
 
   exit(1);
 }
@@ -1167,10 +2132,20 @@ int main(int argc, char* argv[]) {
   string file;
   string user;
   bool genkey = false;
+  int minWorker = 3;
+  int maxWorker = 0;
+  int sessionTimeout = 3600;
+  int searchTimeout = 120;
+  int ticketLifetime = 86400;
+  long sessionMem = 256;
+  bool tagIndex = false;
+  bool rebuildTrigram = false;
+  int searchThreads = 4;
+  long searchCacheMem = 0;
 
   try {
     char ch;
-    while ((ch = getopt(argc, argv, "gP:b:c:a:u:v")) != -1) {
+    while ((ch = getopt(argc, argv, "gP:b:c:a:u:t:s:d:e:k:m:C:iTv")) != -1) {
       switch (ch) {
         case 'g':
           genkey = true;
@@ -1190,6 +2165,63 @@ int main(int argc, char* argv[]) {
         case 'u':
           user = optarg;
           break;
+        case 't': {
+          char *e = nullptr;
+          minWorker = int(strtol(optarg, &e, 10));
+          if (e and *e == ':')
+            maxWorker = int(strtol(e + 1, &e, 10));
+          if (minWorker <= 0 or not e or *e)
+            usage();
+          break;
+        }
+        case 's': {
+          char *e = nullptr;
+          searchThreads = int(strtol(optarg, &e, 10));
+          if (searchThreads < 0 or not e or *e)
+            usage();
+          break;
+        }
+        case 'd': {
+          char *e = nullptr;
+          searchTimeout = int(strtol(optarg, &e, 10));
+          if (searchTimeout < 0 or not e or *e)
+            usage();
+          break;
+        }
+        case 'e': {
+          char *e = nullptr;
+          sessionTimeout = int(strtol(optarg, &e, 10));
+          if (sessionTimeout <= 0 or not e or *e)
+            usage();
+          break;
+        }
+        case 'k': {
+          char *e = nullptr;
+          ticketLifetime = int(strtol(optarg, &e, 10));
+          if (ticketLifetime < 0 or not e or *e)
+            usage();
+          break;
+        }
+        case 'm': {
+          char *e = nullptr;
+          sessionMem = strtol(optarg, &e, 10);
+          if (sessionMem <= 0 or not e or *e)
+            usage();
+          break;
+        }
+        case 'C': {
+          char *e = nullptr;
+          searchCacheMem = strtol(optarg, &e, 10);
+          if (searchCacheMem < 0 or not e or *e)
+            usage();
+          break;
+        }
+        case 'i':
+          tagIndex = true;
+          break;
+        case 'T':
+          rebuildTrigram = true;
+          break;
         case 'v':
           logging::currentLevel = logging::lm_debug;
           break;
@@ -1201,6 +2233,12 @@ int main(int argc, char* argv[]) {
 
     MRpcServer srv;
     srv.service = port;
+    srv.minWorker = minWorker;
+    srv.maxWorker = maxWorker > minWorker ? maxWorker : minWorker;
+    srv.sessionTimeout = sessionTimeout;
+    srv.searchTimeout = searchTimeout;
+    srv.ticketLifetime = ticketLifetime;
+    srv.sessionMemLimit = size_t(sessionMem) * 1024 * 1024;
 
 
 
@@ -1237,6 +2275,10 @@ int main(int argc, char* argv[]) {
       Filestore().loadTemplatesFromFile(configfile);
       return 0;
     }
+    if (rebuildTrigram) {
+      Filestore().rebuildTrigramIndex();
+      return 0;
+    }
 #ifndef NDEBUG
     Filestore store;
     ConfigResult co;
@@ -1249,6 +2291,11 @@ int main(int argc, char* argv[]) {
 //    map<string, BucketPool> buckets;
 //    store.loadBuckets(buckets);
 #endif
+    if (tagIndex)
+      Filestore().buildTagIndex();
+    Filestore::setSearchThreads(size_t(searchThreads));
+    Filestore::setSearchCache(size_t(searchCacheMem) * 1024 * 1024);
+    signal(SIGHUP, MRpcServer::requestReload);
     srv.server();
 
   }
@@ -0,0 +1,122 @@
+// ADMAX Advanced Document Management And Xtras
+//
+// Copyright 2021 Matthias Lautner
+//
+// This is part of MObs https://github.com/AlMarentu/ADMAX.git
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//         http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "tagformat.h"
+
+const char *TagFormat::dateDeRegex = "([0-3]\\d).([01]\\d).([12]\\d{3})";
+const char *TagFormat::dateDeFormat = "%3%d-%2%02d-%1%02d";
+const char *TagFormat::dateIsoRegex = "([12]\\d{3})-([01]\\d)-([0-3]\\d)";
+const char *TagFormat::dateIsoFormat = "%1%d-%2%02d-%3%02d";
+
+namespace {
+
+inline bool isDigit(char c) { return c >= '0' and c <= '9'; }
+
+// entspricht "." im Regex: genau ein Zeichen (UTF-8), kein Zeilenende; liefert die Länge oder 0
+size_t anyChar(const std::string &s, size_t pos) {
+  if (pos >= s.length())
+    return 0;
+  auto c = static_cast<unsigned char>(s[pos]);
+  if (c == '\n' or c == '\r')
+    return 0;
+  size_t len = c < 0x80 ? 1 : c >= 0xf0 ? 4 : c >= 0xe0 ? 3 : c >= 0xc0 ? 2 : 0;
+  if (pos + len > s.length())
+    return 0;
+  for (size_t i = 1; i < len; i++)
+    if ((static_cast<unsigned char>(s[pos + i]) & 0xc0) != 0x80)
+      return 0;
+  return len;
+}
+
+// yyyy-mm-dd an Position pos, Jahr [12]\d{3}, Monat [01]\d, Tag [0-3]\d
+inline bool isYear(const char *p) { return (p[0] == '1' or p[0] == '2') and isDigit(p[1]) and isDigit(p[2]) and isDigit(p[3]); }
+inline bool isMonth(const char *p) { return (p[0] == '0' or p[0] == '1') and isDigit(p[1]); }
+inline bool isDay(const char *p) { return p[0] >= '0' and p[0] <= '3' and isDigit(p[1]); }
+
+}
+
+void TagFormat::insertPattern(const std::string &regex, const std::string &format) {
+  if (regex == dateDeRegex and format == dateDeFormat)
+    rules.emplace_back(DateDe);
+  else if (regex == dateIsoRegex and format == dateIsoFormat)
+    rules.emplace_back(DateIso);
+  else {
+    rules.emplace_back(Custom);
+    rules.back().formatter.insertPattern(mobs::to_wstring(regex), mobs::to_wstring(format));
+  }
+}
+
+void TagFormat::insertDatePatterns() {
+  insertPattern(dateDeRegex, dateDeFormat);
+  insertPattern(dateIsoRegex, dateIsoFormat);
+}
+
+bool TagFormat::format(const std::string &input, std::string &result) const {
+  for (auto const &r:rules) {
+    switch (r.kind) {
+      case DateDe:
+        if (formatDateDe(input, result))
+          return true;
+        break;
+      case DateIso:
+        if (formatDateIso(input, result))
+          return true;
+        break;
+      case Custom: {
+        std::wstring res;
+        if (r.formatter.format(mobs::to_wstring(input), res)) {
+          result = mobs::to_string(res);
+          return true;
+        }
+        break;
+      }
+    }
+  }
+  return false;
+}
+
+bool TagFormat::formatDateDe(const std::string &input, std::string &result) {
+  if (input.length() < 10)
+    return false;
+  size_t s1 = anyChar(input, 2);
+  if (not s1)
+    return false;
+  size_t s2 = anyChar(input, 4 + s1);
+  if (not s2 or input.length() != 8 + s1 + s2)
+    return false;
+  const char *d = input.c_str();
+  const char *m = d + 2 + s1;
+  const char *y = m + 2 + s2;
+  if (not isDay(d) or not isMonth(m) or not isYear(y))
+    return false;
+  char buf[10] = { y[0], y[1], y[2], y[3], '-', m[0], m[1], '-', d[0], d[1] };
+  result.assign(buf, sizeof(buf));
+  return true;
+}
+
+bool TagFormat::formatDateIso(const std::string &input, std::string &result) {
+  if (input.length() != 10 or input[4] != '-' or input[7] != '-')
+    return false;
+  const char *p = input.c_str();
+  if (not isYear(p) or not isMonth(p + 5) or not isDay(p + 8))
+    return false;
+  if (&result != &input)
+    result = input;
+  return true;
+}
@@ -0,0 +1,69 @@
+// ADMAX Advanced Document Management And Xtras
+//
+// Copyright 2021 Matthias Lautner
+//
+// This is part of MObs https://github.com/AlMarentu/ADMAX.git
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//         http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef MOBS_TAGFORMAT_H
+#define MOBS_TAGFORMAT_H
+
+#include <string>
+#include <vector>
+#include <mobs/converter.h>
+
+/** \brief Formatierung von Tag-Inhalten über eine Liste von Regeln
+ *
+ * Die Regeln werden in der Reihenfolge des Einfügens geprüft, die erste passende liefert das Ergebnis.
+ * Die Standard-Datumsmuster (dd.mm.yyyy und ISO) werden erkannt und ohne wregex und ohne Umwandlung
+ * nach wstring ausgewertet; nur echte Custom-Muster laufen über mobs::StringFormatter.
+ */
+class TagFormat {
+public:
+  static const char *dateDeRegex;
+  static const char *dateDeFormat;
+  static const char *dateIsoRegex;
+  static const char *dateIsoFormat;
+
+  void insertPattern(const std::string &regex, const std::string &format);
+  /// beide Standard-Datumsmuster hinzufügen
+  void insertDatePatterns();
+  bool empty() const { return rules.empty(); }
+  /** \brief Inhalt formatieren
+   *
+   * @param input Inhalt
+   * @param result Ergebnis, darf auch input sein
+   * @return true, wenn eine Regel gepasst hat
+   */
+  bool format(const std::string &input, std::string &result) const;
+
+  /// dd.mm.yyyy (beliebiges Trennzeichen) -> yyyy-mm-dd
+  static bool formatDateDe(const std::string &input, std::string &result);
+  /// yyyy-mm-dd prüfen
+  static bool formatDateIso(const std::string &input, std::string &result);
+
+private:
+  enum Kind { DateDe, DateIso, Custom };
+  class Rule {
+  public:
+    explicit Rule(Kind k) : kind(k) {}
+    Kind kind;
+    mobs::StringFormatter formatter{};
+  };
+  std::vector<Rule> rules;
+};
+
+
+#endif //MOBS_TAGFORMAT_H
@@ -0,0 +1,324 @@
+// ADMAX Advanced Document Management And Xtras
+//
+// Copyright 2021 Matthias Lautner
+//
+// This is part of MObs https://github.com/AlMarentu/ADMAX.git
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//         http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "tagindex.h"
+#include <algorithm>
+#include <iterator>
+
+
+void DocBitmap::Container::toBitmap() {
+  if (isBitmap())
+    return;
+  bits.assign(1024, 0);
+  for (auto v:array)
+    bits[v >> 6] |= uint64_t(1) << (v & 63);
+  std::vector<uint16_t>().swap(array);
+}
+
+void DocBitmap::Container::toArray() {
+  if (not isBitmap())
+    return;
+  std::vector<uint16_t> a;
+  a.reserve(card);
+  forEach(0, [&a](uint64_t v) { a.push_back(uint16_t(v)); });
+  array.swap(a);
+  std::vector<uint64_t>().swap(bits);
+}
+
+void DocBitmap::Container::add(uint16_t v) {
+  if (isBitmap()) {
+    uint64_t &w = bits[v >> 6];
+    uint64_t m = uint64_t(1) << (v & 63);
+    if (not (w & m)) {
+      w |= m;
+      card++;
+    }
+    return;
+  }
+  auto it = std::lower_bound(array.begin(), array.end(), v);
+  if (it != array.end() and *it == v)
+    return;
+  array.insert(it, v);
+  card++;
+  if (card > arrayMax)
+    toBitmap();
+}
+
+bool DocBitmap::Container::contains(uint16_t v) const {
+  if (isBitmap())
+    return (bits[v >> 6] & (uint64_t(1) << (v & 63))) != 0;
+  return std::binary_search(array.begin(), array.end(), v);
+}
+
+void DocBitmap::Container::orWith(const Container &o) {
+  if (not isBitmap() and not o.isBitmap() and card + o.card <= arrayMax) {
+    std::vector<uint16_t> a;
+    a.reserve(card + o.card);
+    std::set_union(array.begin(), array.end(), o.array.begin(), o.array.end(), std::back_inserter(a));
+    array.swap(a);
+    card = array.size();
+    return;
+  }
+  toBitmap();
+  if (o.isBitmap()) {
+    for (size_t w = 0; w < bits.size(); w++)
+      bits[w] |= o.bits[w];
+  } else {
+    for (auto v:o.array)
+      bits[v >> 6] |= uint64_t(1) << (v & 63);
+  }
+  card = 0;
+  for (auto w:bits)
+    card += __builtin_popcountll(w);
+  if (card <= arrayMax)
+    toArray();
+}
+
+void DocBitmap::Container::andWith(const Container &o) {
+  if (isBitmap() and o.isBitmap()) {
+    card = 0;
+    for (size_t w = 0; w < bits.size(); w++) {
+      bits[w] &= o.bits[w];
+      card += __builtin_popcountll(bits[w]);
+    }
+    if (card <= arrayMax)
+      toArray();
+    return;
+  }
+  std::vector<uint16_t> a;
+  if (isBitmap()) { // o ist Array
+    for (auto v:o.array)
+      if (contains(v))
+        a.push_back(v);
+    std::vector<uint64_t>().swap(bits);
+  } else if (o.isBitmap()) {
+    for (auto v:array)
+      if (o.contains(v))
+        a.push_back(v);
+  } else
+    std::set_intersection(array.begin(), array.end(), o.array.begin(), o.array.end(), std::back_inserter(a));
+  array.swap(a);
+  card = array.size();
+}
+
+void DocBitmap::add(uint64_t id) {
+  containers[id >> 16].add(uint16_t(id & 0xffff));
+}
+
+bool DocBitmap::contains(uint64_t id) const {
+  auto it = containers.find(id >> 16);
+  return it != containers.end() and it->second.contains(uint16_t(id & 0xffff));
+}
+
+size_t DocBitmap::size() const {
+  size_t sz = 0;
+  for (auto const &c:containers)
+    sz += c.second.card;
+  return sz;
+}
+
+DocBitmap &DocBitmap::operator|=(const DocBitmap &other) {
+  for (auto const &c:other.containers) {
+    auto it = containers.find(c.first);
+    if (it == containers.end())
+      containers.emplace(c.first, c.second);
+    else
+      it->second.orWith(c.second);
+  }
+  return *this;
+}
+
+DocBitmap &DocBitmap::operator&=(const DocBitmap &other) {
+  for (auto it = containers.begin(); it != containers.end();) {
+    auto o = other.containers.find(it->first);
+    if (o != other.containers.end())
+      it->second.andWith(o->second);
+    if (o == other.containers.end() or it->second.card == 0)
+      it = containers.erase(it);
+    else
+      it++;
+  }
+  return *this;
+}
+
+
+
+TagIndex &TagIndex::instance() {
+  static TagIndex tagIndex;
+  return tagIndex;
+}
+
+void TagIndex::add(int64_t tagId, const std::string &content, uint64_t docId) {
+  std::lock_guard<std::mutex> guard(mutex);
+  index[tagId][content].add(docId);
+}
+
+size_t TagIndex::entries() {
+  std::lock_guard<std::mutex> guard(mutex);
+  size_t sz = 0;
+  for (auto const &i:index)
+    sz += i.second.size();
+  return sz;
+}
+
+void TagIndex::range(const ContentMap &cm, const std::string *from, bool fromIncl, const std::string *to, bool toIncl,
+                     DocBitmap &result) {
+  auto it = from ? (fromIncl ? cm.lower_bound(*from) : cm.upper_bound(*from)) : cm.begin();
+  auto end = to ? (toIncl ? cm.upper_bound(*to) : cm.lower_bound(*to)) : cm.end();
+  if (from and to and *to < *from)
+    return;
+  for (; it != end; it++)
+    result |= it->second;
+}
+
+bool TagIndex::single(const ContentMap &cm, const std::string &content, const std::string &op, DocBitmap &result) {
+  if (op == "=") {
+    auto it = cm.find(content);
+    if (it != cm.end())
+      result |= it->second;
+  } else if (op == "<")
+    range(cm, nullptr, false, &content, false, result);
+  else if (op == "<=")
+    range(cm, nullptr, false, &content, true, result);
+  else if (op == ">")
+    range(cm, &content, false, nullptr, false, result);
+  else if (op == ">=")
+    range(cm, &content, true, nullptr, false, result);
+  else if (op == "LIKE") {
+    // nur Präfix-Suche 'abc%'
+    if (content.empty() or content.back() != '%')
+      return false;
+    std::string prefix = content.substr(0, content.length() - 1);
+    if (prefix.find_first_of("%_") != std::string::npos)
+      return false;
+    for (auto it = cm.lower_bound(prefix); it != cm.end() and it->first.compare(0, prefix.length(), prefix) == 0; it++)
+      result |= it->second;
+  } else
+    return false;
+  return true;
+}
+
+bool TagIndex::search(int64_t tagId, const std::multimap<std::string, std::string> &tagOpList, DocBitmap &result) {
+  std::lock_guard<std::mutex> guard(mutex);
+  auto tagIt = index.find(tagId);
+  if (tagIt == index.end())
+    return true;
+  const ContentMap &cm = tagIt->second;
+  if (tagOpList.empty()) {
+    for (auto const &i:cm)
+      result |= i.second;
+    return true;
+  }
+  // Ranges erkennen  >a <b
+  std::string lastOp; // nur > oder >=
+  const std::string *lastCont = nullptr;
+  for (auto &s:tagOpList) {
+    if (s.second == ">" or s.second == ">=") {
+      if (lastOp.empty()) {
+        lastCont = &s.first;
+        lastOp = s.second;
+        continue;
+      } else if (s.second == ">=" and *lastCont == s.first) {
+        lastOp = s.second;
+        continue;
+      } // else ignore, makes no sense
+    } else if (not lastOp.empty() and (s.second == "<" or s.second == "<=")) {
+      range(cm, lastCont, lastOp == ">=", &s.first, s.second == "<=", result);
+      lastOp = "";
+      continue;
+    }
+    if (not single(cm, s.first, s.second, result))
+      return false;
+  }
+  if (not lastOp.empty())
+    return single(cm, *lastCont, lastOp, result);
+  return true;
+}
+
+bool TagIndex::containsAny(int64_t tagId, const std::string &content, const std::vector<uint64_t> &docIds) {
+  std::lock_guard<std::mutex> guard(mutex);
+  auto tagIt = index.find(tagId);
+  if (tagIt == index.end())
+    return false;
+  auto it = tagIt->second.find(content);
+  if (it == tagIt->second.end())
+    return false;
+  for (auto id:docIds)
+    if (it->second.contains(id))
+      return true;
+  return false;
+}
+
+
+
+void GroupIndex::Groups::add(const std::string &group, uint64_t docId) {
+  auto &m = members[group];
+  auto it = std::lower_bound(m.begin(), m.end(), docId);
+  if (it != m.end() and *it == docId)
+    return;
+  m.insert(it, docId);
+  groupOf.emplace(docId, group);
+}
+
+GroupIndex &GroupIndex::instance() {
+  static GroupIndex groupIndex;
+  return groupIndex;
+}
+
+bool GroupIndex::loaded(int64_t groupTagId) {
+  std::lock_guard<std::mutex> guard(mutex);
+  auto it = index.find(groupTagId);
+  return it != index.end() and it->second.complete;
+}
+
+bool GroupIndex::beginLoad(int64_t groupTagId) {
+  std::lock_guard<std::mutex> guard(mutex);
+  return index.emplace(groupTagId, Groups()).second;
+}
+
+void GroupIndex::finishLoad(int64_t groupTagId, const std::vector<std::pair<std::string, uint64_t>> &entries) {
+  std::lock_guard<std::mutex> guard(mutex);
+  Groups &g = index[groupTagId];
+  for (auto &e:entries)
+    g.add(e.first, e.second);
+  g.complete = true;
+}
+
+void GroupIndex::abortLoad(int64_t groupTagId) {
+  std::lock_guard<std::mutex> guard(mutex);
+  index.erase(groupTagId);
+}
+
+void GroupIndex::add(int64_t tagId, const std::string &group, uint64_t docId) {
+  std::lock_guard<std::mutex> guard(mutex);
+  auto it = index.find(tagId);
+  if (it != index.end())
+    it->second.add(group, docId);
+}
+
+bool GroupIndex::members(int64_t groupTagId, const std::string &group, std::vector<uint64_t> &result) {
+  std::lock_guard<std::mutex> guard(mutex);
+  auto it = index.find(groupTagId);
+  if (it == index.end() or not it->second.complete)
+    return false;
+  auto m = it->second.members.find(group);
+  if (m != it->second.members.end())
+    result.insert(result.end(), m->second.begin(), m->second.end());
+  return true;
+}
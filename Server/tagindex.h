@@ -0,0 +1,182 @@
+// ADMAX Advanced Document Management And Xtras
+//
+// Copyright 2021 Matthias Lautner
+//
+// This is part of MObs https://github.com/AlMarentu/ADMAX.git
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//         http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef MOBS_TAGINDEX_H
+#define MOBS_TAGINDEX_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include <mutex>
+#include <set>
+
+/** \brief komprimierte Menge von DocIds (roaring-artig)
+ *
+ * Die oberen 48 Bit wählen einen Container, die unteren 16 Bit werden je nach Dichte als sortiertes Array
+ * oder als Bitmap mit 65536 Bit gespeichert.
+ */
+class DocBitmap {
+public:
+  void add(uint64_t id);
+  bool contains(uint64_t id) const;
+  size_t size() const;
+  bool empty() const { return containers.empty(); }
+  DocBitmap &operator|=(const DocBitmap &other);
+  DocBitmap &operator&=(const DocBitmap &other);
+  /// alle Ids aufsteigend
+  template<class F>
+  void forEach(F f) const {
+    for (auto const &c:containers)
+      c.second.forEach(c.first << 16, f);
+  }
+
+private:
+  class Container {
+  public:
+    std::vector<uint16_t> array; // sortiert, solange card <= arrayMax
+    std::vector<uint64_t> bits;  // 1024 Worte, wenn als Bitmap gespeichert
+    size_t card = 0;
+
+    bool isBitmap() const { return not bits.empty(); }
+    void add(uint16_t v);
+    bool contains(uint16_t v) const;
+    void orWith(const Container &o);
+    void andWith(const Container &o);
+    template<class F>
+    void forEach(uint64_t high, F f) const {
+      if (isBitmap()) {
+        for (size_t w = 0; w < bits.size(); w++) {
+          for (uint64_t b = bits[w]; b; b &= b - 1)
+            f(high | (w * 64 + __builtin_ctzll(b)));
+        }
+      } else {
+        for (auto v:array)
+          f(high | v);
+      }
+    }
+
+  private:
+    void toBitmap();
+    void toArray();
+  };
+  static const size_t arrayMax = 4096;
+  std::map<uint64_t, Container> containers;
+};
+
+
+/** \brief Invertierter Index (tagId, content) -> DocBitmap der aktiven DMGR_Tag
+ *
+ * Optional, wird beim Start aufgebaut und in Filestore::newDocument gepflegt. Da Änderungen anderer
+ * Server-Prozesse nicht gesehen werden, darf er nur verwendet werden, wenn ein einziger Server die DB beschreibt.
+ */
+class TagIndex {
+public:
+  static TagIndex &instance();
+  bool enabled() const { return active; }
+  void enable() { active = true; }
+  void add(int64_t tagId, const std::string &content, uint64_t docId);
+  /** \brief Suche analog zur DB-Query in Filestore::searchHits
+   *
+   * @param tagId Tag-Id
+   * @param tagOpList Liste aus (Inhalt, Operator), werden oder-verknüpft; Bereiche aus > und < werden zusammengefasst
+   * @param result Ergebnismenge
+   * @return false, wenn ein Operator nicht unterstützt wird und die DB befragt werden muss
+   */
+  bool search(int64_t tagId, const std::multimap<std::string, std::string> &tagOpList, DocBitmap &result);
+  /// ist (tagId, content) an einem der Dokumente vorhanden
+  bool containsAny(int64_t tagId, const std::string &content, const std::vector<uint64_t> &docIds);
+  size_t entries();
+
+private:
+  using ContentMap = std::map<std::string, DocBitmap>;
+  void range(const ContentMap &cm, const std::string *from, bool fromIncl, const std::string *to, bool toIncl,
+             DocBitmap &result);
+  bool single(const ContentMap &cm, const std::string &content, const std::string &op, DocBitmap &result);
+
+  std::mutex mutex;
+  bool active = false;
+  std::map<int64_t, ContentMap> index;
+};
+
+
+/** \brief Zuordnung Gruppe -> DocIds und DocId -> Gruppe je Gruppen-Tag
+ *
+ * Ersetzt bei der Gruppen-Erweiterung der Suche und beim Zusammenfassen von Tags einer Gruppe die
+ * IN-Listen-Queries. Ein Gruppen-Tag wird beim ersten Zugriff aus der DB geladen (beginLoad/finishLoad) und
+ * danach in Filestore::newDocument gepflegt. Es gilt dieselbe Einschränkung wie für TagIndex.
+ */
+class GroupIndex {
+public:
+  static GroupIndex &instance();
+  bool enabled() const { return active; }
+  void enable() { active = true; }
+  /// true, wenn der Gruppen-Tag vollständig geladen ist
+  bool loaded(int64_t groupTagId);
+  /// ab jetzt Einträge mit add sammeln; false, wenn bereits geladen oder ein anderer Thread lädt
+  bool beginLoad(int64_t groupTagId);
+  /// Einträge aus der DB übernehmen und als vollständig markieren
+  void finishLoad(int64_t groupTagId, const std::vector<std::pair<std::string, uint64_t>> &entries);
+  /// Laden abgebrochen
+  void abortLoad(int64_t groupTagId);
+  /// wird für jeden gespeicherten Tag aufgerufen, nicht geladene Tags werden ignoriert
+  void add(int64_t tagId, const std::string &group, uint64_t docId);
+  /** \brief alle Dokumente der Gruppen von docIds
+   *
+   * @param result wird mit push_back um die Gruppenmitglieder ergänzt, nicht normalisiert
+   * @return false, wenn der Gruppen-Tag nicht geladen ist
+   */
+  template<class C, class R>
+  bool expand(int64_t groupTagId, const C &docIds, R &result) {
+    std::lock_guard<std::mutex> guard(mutex);
+    auto it = index.find(groupTagId);
+    if (it == index.end() or not it->second.complete)
+      return false;
+    std::set<const std::vector<uint64_t> *> done;
+    for (auto id:docIds) {
+      auto range = it->second.groupOf.equal_range(id);
+      for (auto g = range.first; g != range.second; g++) {
+        auto m = it->second.members.find(g->second);
+        if (m != it->second.members.end() and done.insert(&m->second).second)
+          for (auto d:m->second)
+            result.push_back(d);
+      }
+    }
+    return true;
+  }
+  /// Mitglieder einer Gruppe; false, wenn der Gruppen-Tag nicht geladen ist
+  bool members(int64_t groupTagId, const std::string &group, std::vector<uint64_t> &result);
+
+private:
+  class Groups {
+  public:
+    bool complete = false;
+    std::map<std::string, std::vector<uint64_t>> members;  // Gruppe -> DocIds aufsteigend
+    std::unordered_multimap<uint64_t, std::string> groupOf; // DocId -> Gruppe
+    void add(const std::string &group, uint64_t docId);
+  };
+
+  std::mutex mutex;
+  bool active = false;
+  std::map<int64_t, Groups> index;
+};
+
+
+#endif //MOBS_TAGINDEX_H